@@ -0,0 +1,240 @@
+/**
+ * @file Alarm.h
+ *
+ * @brief Alarms kept in a min-heap on their next ring time, so
+ * only the earliest one ever needs a timer.
+ *
+ * This header has no mbed dependencies so the same code
+ * runs on the device and on a host computer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include "Calendar.h"
+#include <stdint.h>
+#include <time.h>
+
+/** Days an alarm rings on, bit 0 is Sunday; 0 rings once */
+const uint8_t ALARM_ONCE = 0x00;
+const uint8_t ALARM_WEEKDAYS = 0x3E;
+const uint8_t ALARM_DAILY = 0x7F;
+
+/** One alarm, in local time */
+struct Alarm {
+    uint8_t hour;       /**< 0..23 */
+    uint8_t minute;     /**< 0..59 */
+    uint8_t days;       /**< ALARM_ONCE or a mask of weekdays */
+
+    bool operator==(const Alarm &other) const {
+        return hour == other.hour && minute == other.minute && days == other.days;
+    }
+};
+
+/**
+ * @return the first time after a given time that an alarm rings,
+ * both in local seconds since 1970
+ */
+inline time_t alarmNext(const Alarm &alarm, time_t after) {
+    int64_t seconds = after;
+    int32_t day = seconds / SECONDS_PER_DAY;
+    if (seconds % SECONDS_PER_DAY < 0)
+        day--;
+
+    int32_t time_of_day = alarm.hour*3600 + alarm.minute*60;
+    if (int64_t(day)*SECONDS_PER_DAY + time_of_day <= seconds)
+        day++;
+
+    /** At most six days go by before a day in the mask */
+    if (alarm.days != ALARM_ONCE)
+        while (!(alarm.days & (1 << weekdayFromDays(day))))
+            day++;
+
+    return time_t(int64_t(day)*SECONDS_PER_DAY + time_of_day);
+}
+
+/**
+ * @brief Up to Capacity alarms, ordered by when they ring next.
+ *
+ * The alarms sit in fixed slots and a binary min-heap of
+ * (ring time, slot) pairs orders them, with each slot's heap
+ * position kept so any alarm can be removed. next() is O(1);
+ * adding, removing and ringing an alarm are O(log n). Nothing
+ * needs to look at the alarms between rings, so the application
+ * arms a single timer for next() and does no per-second work.
+ *
+ * Times are local seconds since 1970. After the clock is set or
+ * the time zone changes, reschedule() works every ring time out
+ * again.
+ *
+ * @tparam Capacity Largest number of alarms (up to 127)
+ */
+template<int Capacity>
+class AlarmScheduler {
+public:
+
+    static_assert(Capacity > 0 && Capacity <= 127, "slots must fit 8-bit heap positions");
+
+    AlarmScheduler() {
+        clear();
+    }
+
+    /** @brief Removes every alarm */
+    void clear() {
+        _size = 0;
+        for (int i = 0; i < Capacity; i++)
+            _pos[i] = -1;
+    }
+
+    /**
+     * @brief Adds an alarm.
+     *
+     * @param now Current local time
+     * @return slot of the alarm, -1 if every slot is in use
+     */
+    int add(const Alarm &alarm, time_t now) {
+        if (_size == Capacity)
+            return -1;
+
+        int slot = 0;
+        while (_pos[slot] >= 0)
+            slot++;
+
+        _alarms[slot] = alarm;
+        _heap[_size].time = alarmNext(alarm, now);
+        _heap[_size].slot = slot;
+        _pos[slot] = _size;
+        siftUp(_size++);
+        return slot;
+    }
+
+    /** @brief Removes the alarm in a slot */
+    void remove(int slot) {
+        int pos = _pos[slot];
+        if (pos < 0)
+            return;
+
+        _pos[slot] = -1;
+        if (pos == --_size)
+            return;
+
+        /** The last entry fills the hole and moves whichever way it must */
+        int moved = _heap[_size].slot;
+        _heap[pos] = _heap[_size];
+        _pos[moved] = pos;
+        siftUp(pos);
+        siftDown(_pos[moved]);
+    }
+
+    /** @return slot of an alarm equal to the given one, -1 if none */
+    int find(const Alarm &alarm) const {
+        for (int slot = 0; slot < Capacity; slot++)
+            if (_pos[slot] >= 0 && _alarms[slot] == alarm)
+                return slot;
+        return -1;
+    }
+
+    /**
+     * @brief Takes the earliest alarm if it is due.
+     *
+     * A one-shot alarm is removed; a repeating one moves on to its
+     * next ring after now.
+     *
+     * @param now   Current local time
+     * @param alarm Set to the alarm that rang
+     * @return false if no alarm is due
+     */
+    bool take(time_t now, Alarm &alarm) {
+        if (_size == 0 || _heap[0].time > now)
+            return false;
+
+        int slot = _heap[0].slot;
+        alarm = _alarms[slot];
+        if (alarm.days == ALARM_ONCE)
+            remove(slot);
+        else {
+            _heap[0].time = alarmNext(alarm, now);
+            siftDown(0);
+        }
+        return true;
+    }
+
+    /** @brief Works out every ring time again after now, in O(n) */
+    void reschedule(time_t now) {
+        for (int i = 0; i < _size; i++)
+            _heap[i].time = alarmNext(_alarms[_heap[i].slot], now);
+        for (int i = _size/2 - 1; i >= 0; i--)
+            siftDown(i);
+    }
+
+    /** @return local time the earliest alarm rings; only valid if count() > 0 */
+    time_t next() const {
+        return _heap[0].time;
+    }
+
+    /** @return number of alarms */
+    int count() const {
+        return _size;
+    }
+
+    /** @return true if a slot holds an alarm */
+    bool used(int slot) const {
+        return _pos[slot] >= 0;
+    }
+
+    /** @return the alarm in a slot */
+    const Alarm &alarm(int slot) const {
+        return _alarms[slot];
+    }
+
+    /** @return local time the alarm in a slot rings next */
+    time_t ringTime(int slot) const {
+        return _heap[_pos[slot]].time;
+    }
+
+private:
+
+    struct Entry {
+        time_t time;
+        int8_t slot;
+    };
+
+    void swap(int a, int b) {
+        Entry entry = _heap[a];
+        _heap[a] = _heap[b];
+        _heap[b] = entry;
+        _pos[_heap[a].slot] = a;
+        _pos[_heap[b].slot] = b;
+    }
+
+    void siftUp(int pos) {
+        while (pos > 0 && _heap[pos].time < _heap[(pos - 1)/2].time) {
+            swap(pos, (pos - 1)/2);
+            pos = (pos - 1)/2;
+        }
+    }
+
+    void siftDown(int pos) {
+        for (;;) {
+            int least = pos, child = 2*pos + 1;
+            if (child < _size && _heap[child].time < _heap[least].time)
+                least = child;
+            if (child + 1 < _size && _heap[child + 1].time < _heap[least].time)
+                least = child + 1;
+            if (least == pos)
+                return;
+            swap(pos, least);
+            pos = least;
+        }
+    }
+
+    Alarm _alarms[Capacity];
+    Entry _heap[Capacity];
+    int8_t _pos[Capacity];  /**< heap position of each slot, -1 if unused */
+    int _size;
+};
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file AnalogTempSensor.cpp
+ *
+ * @brief The analog temperature sensor behind the TempSensor
+ * interface, so the scheduler can poll it like the bus sensors.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "AnalogTempSensor.h"
+
+AnalogTempSensor::AnalogTempSensor(TempAcquisition &acquisition, TempTable &table) :
+        _acquisition(acquisition), _table(table) {}
+
+bool AnalogTempSensor::start() {
+    return true;
+}
+
+bool AnalogTempSensor::poll() {
+    return true;
+}
+
+bool AnalogTempSensor::read(int16_t &tenths_c) {
+    tenths_c = _table.celsius(_acquisition.code());
+    return true;
+}
+
+int AnalogTempSensor::conversionMs() const {
+    return 0;
+}
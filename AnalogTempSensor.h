@@ -0,0 +1,42 @@
+/**
+ * @file AnalogTempSensor.h
+ *
+ * @brief The analog temperature sensor behind the TempSensor
+ * interface, so the scheduler can poll it like the bus sensors.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef ANALOGTEMPSENSOR_H
+#define ANALOGTEMPSENSOR_H
+
+#include "mbed.h"
+#include "TempSensor.h"
+#include "Temperature.h"
+#include "TempTable.h"
+
+/**
+ * @brief The analog sensor. TempAcquisition already samples it in
+ * the background, so a conversion finishes as soon as it starts.
+ */
+class AnalogTempSensor : public TempSensor {
+public:
+
+    /**
+     * @param acquisition Background sampler of the sensor
+     * @param table       ADC code to temperature table
+     */
+    AnalogTempSensor(TempAcquisition &acquisition, TempTable &table);
+
+    virtual bool start();
+    virtual bool poll();
+    virtual bool read(int16_t &tenths_c);
+    virtual int conversionMs() const;
+
+private:
+    TempAcquisition &_acquisition;
+    TempTable &_table;
+};
+
+#endif
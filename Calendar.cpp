@@ -0,0 +1,93 @@
+/**
+ * @file Calendar.cpp
+ *
+ * @brief Broken-down date and time kept up to date one second
+ * at a time, without localtime() or mktime().
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Calendar.h"
+
+void civilFromDays(int32_t days, DateTime &date) {
+    date.weekday = weekdayFromDays(days);
+
+    /** Same March based 400 year eras as daysFromCivil() */
+    days += 719468;
+    int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int32_t doe = days - era*146097;
+    int32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    int32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+    int32_t mp = (5*doy + 2)/153;
+
+    date.day = doy - (153*mp + 2)/5 + 1;
+    date.month = mp < 10 ? mp + 3 : mp - 9;
+    date.year = yoe + era*400 + (date.month <= 2);
+}
+
+void dateTimeFromTime(time_t time, DateTime &date) {
+    /** Round towards the earlier day for times before 1970 */
+    int64_t seconds = time;
+    int32_t days = seconds / SECONDS_PER_DAY;
+    int32_t rest = seconds % SECONDS_PER_DAY;
+    if (rest < 0) {
+        days--;
+        rest += SECONDS_PER_DAY;
+    }
+
+    civilFromDays(days, date);
+    date.hour = rest / 3600;
+    date.minute = rest / 60 % 60;
+    date.second = rest % 60;
+}
+
+time_t timeFromDateTime(const DateTime &date) {
+    int64_t days = daysFromCivil(date.year, date.month, date.day);
+    return days*SECONDS_PER_DAY + date.hour*3600 + date.minute*60 + date.second;
+}
+
+Calendar::Calendar(time_t time) {
+    set(time);
+}
+
+const DateTime &Calendar::update(time_t time) {
+    if (time - _time > 0 && time - _time <= MAX_STEPS) {
+        while (_time != time)
+            tick();
+    }
+    else if (time != _time)
+        set(time);
+    return _now;
+}
+
+void Calendar::set(time_t time) {
+    _time = time;
+    dateTimeFromTime(time, _now);
+}
+
+void Calendar::set(const DateTime &date) {
+    set(timeFromDateTime(date));
+}
+
+void Calendar::tick() {
+    _time++;
+    if (++_now.second < 60)
+        return;
+    _now.second = 0;
+    if (++_now.minute < 60)
+        return;
+    _now.minute = 0;
+    if (++_now.hour < 24)
+        return;
+    _now.hour = 0;
+
+    _now.weekday = _now.weekday == 6 ? 0 : _now.weekday + 1;
+    if (++_now.day <= daysInMonth(_now.year, _now.month))
+        return;
+    _now.day = 1;
+    if (++_now.month <= 12)
+        return;
+    _now.month = 1;
+    _now.year++;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file Calendar.h
+ *
+ * @brief Broken-down date and time kept up to date one second
+ * at a time, without localtime() or mktime().
+ *
+ * This header has no mbed dependencies so the same code
+ * runs on the device and on a host computer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include <stdint.h>
+#include <time.h>
+
+const int32_t SECONDS_PER_DAY = 86400;
+
+/** A date and time of day, in the proleptic Gregorian calendar */
+struct DateTime {
+    int16_t year;
+    uint8_t month;      /**< 1..12 */
+    uint8_t day;        /**< 1..31 */
+    uint8_t hour;       /**< 0..23 */
+    uint8_t minute;     /**< 0..59 */
+    uint8_t second;     /**< 0..59 */
+    uint8_t weekday;    /**< 0..6, Sunday is 0 */
+};
+
+constexpr bool isLeapYear(int year) {
+    return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+/** @return number of days in a month of a year */
+constexpr int daysInMonth(int year, int month) {
+    return month == 2 ? (isLeapYear(year) ? 29 : 28)
+                      : 30 + ((month + (month >> 3)) & 1);
+}
+
+/**
+ * @brief Counts days from 1970-01-01 to a date.
+ *
+ * Counts in 400 year eras starting on March 1st, so leap days
+ * fall at the end of a year and no table is needed.
+ *
+ * @return days since 1970-01-01, negative before it
+ */
+constexpr int32_t daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int32_t era = (year >= 0 ? year : year - 399) / 400;
+    int32_t yoe = year - era*400;
+    int32_t doy = (153*(month > 2 ? month - 3 : month + 9) + 2)/5 + day - 1;
+    int32_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    return era*146097 + doe - 719468;
+}
+
+/** @return day of the week of a day count, Sunday is 0 */
+constexpr int weekdayFromDays(int32_t days) {
+    return days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6;
+}
+
+/** @brief Fills in the date and weekday of a day count; the inverse of daysFromCivil() */
+void civilFromDays(int32_t days, DateTime &date);
+
+/** @brief Converts seconds since 1970 to a date and time */
+void dateTimeFromTime(time_t time, DateTime &date);
+
+/** @return seconds since 1970 of a date and time */
+time_t timeFromDateTime(const DateTime &date);
+
+/**
+ * @brief Keeps the broken-down time of a running clock.
+ *
+ * update() is given the clock's time every second or so. When the
+ * time has moved on by a few seconds it is stepped forward,
+ * carrying seconds into minutes, hours, days, months and years,
+ * which costs a few compares. Any other change, e.g. the clock
+ * being set, converts the time in full.
+ *
+ * There is no shared static state, unlike localtime(), so any
+ * number of calendars can be used side by side.
+ *
+ * @code
+ * Calendar calendar;
+ * const DateTime &now = calendar.update(time(NULL));
+ * @endcode
+ */
+class Calendar {
+public:
+
+    /** Longest forward jump that is stepped rather than converted */
+    static const int MAX_STEPS = 8;
+
+    Calendar(time_t time = 0);
+
+    /**
+     * @brief Brings the date and time up to a new time.
+     *
+     * @param time Seconds since 1970.
+     * @return the date and time at that time
+     */
+    const DateTime &update(time_t time);
+
+    /** @brief Jumps to a time, e.g. after the clock was set */
+    void set(time_t time);
+
+    /** @brief Jumps to a date and time */
+    void set(const DateTime &date);
+
+    /** @return the current date and time */
+    const DateTime &now() const {
+        return _now;
+    }
+
+    /** @return the current time in seconds since 1970 */
+    time_t time() const {
+        return _time;
+    }
+
+private:
+
+    /** Moves on by one second */
+    void tick();
+
+    DateTime _now;
+    time_t _time;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file KeyEvents.h
+ *
+ * @brief Press, repeat, long-press and release events for keypads.
+ *
+ * It has no mbed dependencies, so the keypad drivers that feed it
+ * can be checked on a host.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef KEYEVENTS_H
+#define KEYEVENTS_H
+
+#include <stdint.h>
+
+/** Kinds of events produced by KeyEvents */
+enum KeyEventType {
+    KEY_PRESS,      /**< key went down */
+    KEY_REPEAT,     /**< key is held; sent at the typematic rate */
+    KEY_LONG_PRESS, /**< key has been held for the long-press time */
+    KEY_RELEASE     /**< key went up */
+};
+
+/** A key event as handed to the application */
+struct KeyEvent {
+    char key;
+    KeyEventType type;
+};
+
+/**
+ * @brief Turns debounced key presses and releases into
+ * press, auto-repeat, long-press and release events.
+ *
+ * Like a PC keyboard, only the most recently pressed key
+ * repeats. It first repeats after the initial delay, then
+ * once every repeat period for as long as it is held. A
+ * single long-press event is sent once it has been held for
+ * the long-press time.
+ *
+ * Keys are identified by their index in the matrix
+ * (row*columns + col). Times are in milliseconds from any
+ * free-running clock and may wrap.
+ */
+class KeyEvents {
+public:
+
+    /**
+     * @param delay_ms Hold time before the first repeat
+     * @param rate_ms  Time between repeats after that
+     * @param long_ms  Hold time before the long-press event
+     */
+    KeyEvents(int delay_ms = 400, int rate_ms = 80, int long_ms = 1000);
+
+    /** Changes the typematic delay and rate */
+    void setRepeat(int delay_ms, int rate_ms);
+
+    /** Changes the long-press time */
+    void setLongPress(int long_ms);
+
+    /** Records that key went down at now_ms */
+    void press(int key, uint32_t now_ms);
+
+    /** Records that key went up at now_ms */
+    void release(int key, uint32_t now_ms);
+
+    /** Sends any repeat or long-press events that are due */
+    void tick(uint32_t now_ms);
+
+    /**
+     * @brief Takes the oldest queued event.
+     *
+     * @return false if no event is queued.
+     */
+    bool get(int &key, KeyEventType &type);
+
+    /** @return true while a key is held and may still repeat */
+    bool active() const;
+
+private:
+    void push(int key, KeyEventType type);
+
+    static const int QUEUE_SIZE = 16;
+
+    int _delay_ms, _rate_ms, _long_ms;
+
+    int _held_key;
+    uint32_t _held_since;
+    uint32_t _next_repeat;
+    bool _long_sent;
+
+    uint8_t _keys[QUEUE_SIZE];
+    uint8_t _types[QUEUE_SIZE];
+    int _head, _count;
+};
+
+#endif
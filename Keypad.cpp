@@ -0,0 +1,87 @@
+/**
+ * @file Keypad.cpp
+ *
+ * @brief Key event generation for the matrix keypad.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "KeyEvents.h"
+
+KeyEvents::KeyEvents(int delay_ms, int rate_ms, int long_ms) :
+        _delay_ms(delay_ms), _rate_ms(rate_ms), _long_ms(long_ms),
+        _held_key(-1), _held_since(0), _next_repeat(0), _long_sent(false),
+        _head(0), _count(0) {
+}
+
+void KeyEvents::setRepeat(int delay_ms, int rate_ms) {
+    _delay_ms = delay_ms;
+    _rate_ms = rate_ms;
+}
+
+void KeyEvents::setLongPress(int long_ms) {
+    _long_ms = long_ms;
+}
+
+void KeyEvents::press(int key, uint32_t now_ms) {
+    push(key, KEY_PRESS);
+
+    /** The newest key takes over the typematic */
+    _held_key = key;
+    _held_since = now_ms;
+    _next_repeat = now_ms + _delay_ms;
+    _long_sent = false;
+}
+
+void KeyEvents::release(int key, uint32_t) {
+    push(key, KEY_RELEASE);
+    if (key == _held_key)
+        _held_key = -1;
+}
+
+void KeyEvents::tick(uint32_t now_ms) {
+    if (_held_key < 0)
+        return;
+
+    if (!_long_sent && now_ms - _held_since >= (uint32_t)_long_ms) {
+        push(_held_key, KEY_LONG_PRESS);
+        _long_sent = true;
+    }
+
+    /** Signed difference so the check survives clock wrap */
+    if ((int32_t)(now_ms - _next_repeat) >= 0) {
+        push(_held_key, KEY_REPEAT);
+        _next_repeat += _rate_ms;
+
+        /** Drop repeats that were missed instead of bursting them */
+        if ((int32_t)(now_ms - _next_repeat) >= 0)
+            _next_repeat = now_ms + _rate_ms;
+    }
+}
+
+bool KeyEvents::get(int &key, KeyEventType &type) {
+    if (_count == 0)
+        return false;
+
+    key = _keys[_head];
+    type = (KeyEventType)_types[_head];
+    _head = (_head + 1) % QUEUE_SIZE;
+    _count--;
+    return true;
+}
+
+bool KeyEvents::active() const {
+    return _held_key >= 0 || _count != 0;
+}
+
+void KeyEvents::push(int key, KeyEventType type) {
+    /** A full queue drops the new event */
+    if (_count == QUEUE_SIZE)
+        return;
+
+    int tail = (_head + _count) % QUEUE_SIZE;
+    _keys[tail] = key;
+    _types[tail] = type;
+    _count++;
+}
@@ -0,0 +1,493 @@
+/**
+ * @file Keypad.h
+ *
+ * @brief Scanning, debouncing and key events for
+ * matrix keypads of up to 64 keys.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include "mbed.h"
+#include "KeyEvents.h"
+#include <stdint.h>
+#include <type_traits>
+
+/** Columns are read a whole GPIO port at a time where the target allows it */
+#if DEVICE_PORTIN && defined(TARGET_STM)
+#define KEYPAD_PORT_READ 1
+#else
+#define KEYPAD_PORT_READ 0
+#endif
+
+/**
+ * @brief Picks the smallest unsigned type with one bit per key.
+ *
+ * A 4x4 keypad fits in a uint16_t, an 8x8 pad needs a uint64_t.
+ */
+template<int Keys>
+struct KeyMaskFor {
+    static_assert(Keys <= 64, "keypads are limited to 64 keys");
+    typedef typename std::conditional<(Keys <= 16), uint16_t,
+            typename std::conditional<(Keys <= 32), uint32_t, uint64_t>::type>::type type;
+};
+
+/**
+ * @brief Debounces every key of a keypad at once
+ * using a 2-bit vertical counter.
+ *
+ * Every key owns one bit of each state word (bit = row*columns + col).
+ * The two counter words hold a separate 2-bit counter per key, so
+ * one update() costs a handful of bitwise operations no matter how
+ * many keys are bouncing.
+ *
+ * A key only changes its debounced state after it has disagreed with
+ * that state for four scans in a row. Presses and releases are timed
+ * per key, so different keys never lock each other out.
+ *
+ * @tparam Mask Unsigned type with at least one bit per key.
+ */
+template<typename Mask = uint16_t>
+class VerticalDebouncer {
+public:
+
+    /** Number of agreeing scans needed before a key changes state */
+    static const int SAMPLES = 4;
+
+    VerticalDebouncer() : _state(0), _ct0(~Mask(0)), _ct1(~Mask(0)), _pressed(0), _released(0) {}
+
+    /**
+     * @brief Feeds one raw scan of the keypad into the counters.
+     *
+     * @param raw Bit set for every key that currently reads as pressed.
+     */
+    void update(Mask raw) {
+        Mask changed = _state ^ raw;
+
+        /** Counters of keys that agree with their state are reset to 3 */
+        _ct0 = ~(_ct0 & changed);
+        _ct1 = _ct0 ^ (_ct1 & changed);
+
+        /** Keys whose counter rolled over from 0 flip their state */
+        changed &= _ct0 & _ct1;
+        _state ^= changed;
+        _pressed |= _state & changed;
+        _released |= ~_state & changed;
+    }
+
+    /** @return the debounced state of all keys (1 = pressed) */
+    Mask state() const {
+        return _state;
+    }
+
+    /** @return keys that became pressed since the last call */
+    Mask takePressed() {
+        Mask keys = _pressed;
+        _pressed = 0;
+        return keys;
+    }
+
+    /** @return keys that became released since the last call */
+    Mask takeReleased() {
+        Mask keys = _released;
+        _released = 0;
+        return keys;
+    }
+
+private:
+    Mask _state;
+    Mask _ct0, _ct1;
+    Mask _pressed, _released;
+};
+
+/**
+ * @brief Finds keys that may be ghosts in a diodeless matrix.
+ *
+ * When three corners of a rectangle of keys are held, current
+ * sneaks through them and the fourth corner reads as pressed too.
+ * Any two rows that share two or more active columns form such a
+ * rectangle, and none of its corners can be trusted.
+ *
+ * @param raw Raw scan of all keys (bit = row*Cols + col).
+ * @return Mask of every key that sits on an ambiguous rectangle.
+ */
+template<int Rows, int Cols, typename Mask>
+Mask ghostMask(Mask raw) {
+    const Mask row_bits = (Mask(1) << Cols) - 1;
+    Mask ghosts = 0;
+
+    for (int i = 0; i < Rows; i++) {
+        for (int j = i + 1; j < Rows; j++) {
+            Mask common = (raw >> (i*Cols)) & (raw >> (j*Cols)) & row_bits;
+
+            /** Two or more shared columns make a rectangle */
+            if (common & (common - 1))
+                ghosts |= (common << (i*Cols)) | (common << (j*Cols));
+        }
+    }
+    return ghosts;
+}
+
+/**
+ * @brief mbed's microsecond ticker and callback type, for keypad
+ * drivers written without mbed, like TCA8418Keypad.
+ */
+struct MbedKeypadPlatform {
+    typedef Callback<void()> Handler;
+
+    static uint32_t nowUs() {
+        return us_ticker_read();
+    }
+};
+
+/**
+ * @brief Scans a Rows x Cols matrix keypad and turns it into
+ * key events.
+ *
+ * While idle all rows are driven low, so any key press pulls
+ * its column low and fires that column's interrupt. Nothing is
+ * scanned until a column interrupt has fired or a key is held.
+ *
+ * A single active column is resolved to its row by binary
+ * search: half of the remaining rows are driven low and the
+ * columns are checked, which takes log2(Rows) settle periods
+ * plus one to make sure no other row holds a key in the same
+ * column. Several active columns fall back to a full scan, one
+ * row at a time, so chords are still read in full.
+ *
+ * On STM32 targets the columns are grouped by GPIO port and each
+ * port is read once per probe, the way a PortIn reads it.
+ *
+ * Everything lives inside the object, so several keypads can
+ * be used in one firmware without any heap use.
+ *
+ * @code
+ * constexpr PinName row_pins[] = {PA_6, PA_7, PB_6, PC_7};
+ * constexpr PinName col_pins[] = {PA_9, PA_8, PB_10};
+ * constexpr char key_map[4][3] = {
+ *         {'1', '2', '3'},
+ *         {'4', '5', '6'},
+ *         {'7', '8', '9'},
+ *         {'*', '0', '#'},
+ * };
+ * MatrixKeypad<4, 3> keypad(row_pins, col_pins, key_map);
+ * @endcode
+ */
+template<int Rows, int Cols>
+class MatrixKeypad {
+public:
+
+    /** One bit per key (bit = row*Cols + col) */
+    typedef typename KeyMaskFor<Rows * Cols>::type KeyMask;
+
+    /**
+     * @param row_pins  Pins driving the rows
+     * @param col_pins  Pins reading the columns
+     * @param key_map   Character reported for each key
+     * @param settle_us Time a row is given to settle before reading
+     */
+    MatrixKeypad(const PinName (&row_pins)[Rows], const PinName (&col_pins)[Cols],
+                 const char (&key_map)[Rows][Cols], int settle_us = 20) :
+            _key_map(key_map), _settle_us(settle_us), _ghosted(false), _new_ghost(false),
+            _activity(true), _busy(false), _edge_us(0), _wake_us(0), _wake_valid(false),
+            _press_edge_us(0), _press_detect_us(0) {
+
+        /** Rows idle low so a press shows up on its column */
+        for (int i = 0; i < Rows; i++)
+            gpio_init_out_ex(&_rows[i], row_pins[i], 0);
+
+#if KEYPAD_PORT_READ
+        /** Give each GPIO port the columns wired to it */
+        _num_ports = 0;
+        for (int i = 0; i < Cols; i++) {
+            PortName port = (PortName)STM_PORT(col_pins[i]);
+            int p = 0;
+            while (p < _num_ports && _port_names[p] != port)
+                p++;
+            if (p == _num_ports) {
+                _port_names[p] = port;
+                _port_masks[p] = 0;
+                _num_ports++;
+            }
+            _port_masks[p] |= 1u << STM_PIN(col_pins[i]);
+            _col_port[i] = p;
+            _col_bit[i] = 1u << STM_PIN(col_pins[i]);
+        }
+        for (int p = 0; p < _num_ports; p++) {
+            port_init(&_ports[p], _port_names[p], _port_masks[p], PIN_INPUT);
+            port_mode(&_ports[p], PullUp);
+        }
+#else
+        for (int i = 0; i < Cols; i++)
+            gpio_init_in_ex(&_cols[i], col_pins[i], PullUp);
+#endif
+
+#if DEVICE_INTERRUPTIN
+        for (int i = 0; i < Cols; i++) {
+            gpio_irq_init(&_col_irqs[i], col_pins[i], &MatrixKeypad::columnIrq, (uintptr_t)this);
+            gpio_irq_set(&_col_irqs[i], IRQ_FALL, 1);
+            gpio_irq_enable(&_col_irqs[i]);
+        }
+#endif
+    }
+
+    /**
+     * @brief Reads every key of the matrix once.
+     *
+     * A key released while its row is being searched for may be
+     * placed in the wrong row for that one scan; the debouncer
+     * needs four agreeing scans, so this never becomes an event.
+     *
+     * @return Bit set for each key that reads as pressed.
+     */
+    KeyMask scan() {
+        const KeyMask all_rows = rowRange(0, Rows);
+
+        /** The rows idle low, so this read needs no settle time */
+        int cols = readColumns();
+        if (cols == 0)
+            return 0;
+
+        KeyMask raw = 0;
+        bool resolved = false;
+
+        if (!(cols & (cols - 1))) {
+            int low = 0, high = Rows;
+            while (high - low > 1) {
+                int mid = (low + high) / 2;
+                if (probe(rowRange(low, mid)) & cols)
+                    high = mid;
+                else
+                    low = mid;
+            }
+
+            if (Rows == 1 || !(probe(all_rows & ~rowRange(low, low + 1)) & cols)) {
+                raw = KeyMask(cols) << (low*Cols);
+                resolved = true;
+            }
+        }
+
+        if (!resolved) {
+            for (int i = 0; i < Rows; i++)
+                raw |= KeyMask(probe(rowRange(i, i + 1))) << (i*Cols);
+        }
+
+        /** Back to idle with every row low */
+        drive(all_rows);
+        return raw;
+    }
+
+    /**
+     * @brief Scans, debounces and queues the resulting key events.
+     *
+     * Call this at a fixed period; four calls make up the debounce
+     * time of each key.
+     *
+     * @param now_ms Milliseconds from a free-running clock.
+     */
+    void update(uint32_t now_ms) {
+#if DEVICE_INTERRUPTIN
+        /** Idle keypad and no column edge: nothing to scan */
+        if (!_activity && !_busy) {
+            _events.tick(now_ms);
+            return;
+        }
+        _activity = false;
+
+        /** The edge that woke an idle keypad starts the next press */
+        if (!_busy) {
+            _wake_us = _edge_us;
+            _wake_valid = true;
+        }
+#endif
+
+        KeyMask raw = scan();
+
+        /** Keys on a ghost rectangle keep their last state */
+        KeyMask ghosts = ghostMask<Rows, Cols>(raw);
+        raw = (raw & ~ghosts) | (_debouncer.state() & ghosts);
+        _new_ghost |= ghosts && !_ghosted;
+        _ghosted = ghosts != 0;
+
+        _debouncer.update(raw);
+        KeyMask released = _debouncer.takeReleased();
+        KeyMask pressed = _debouncer.takePressed();
+        if (pressed) {
+            _press_detect_us = us_ticker_read();
+            _press_edge_us = _wake_valid ? _wake_us : _press_detect_us;
+            _wake_valid = false;
+        }
+        for (int key = 0; key < Rows * Cols; key++) {
+            if (released & (KeyMask(1) << key))
+                _events.release(key, now_ms);
+        }
+        for (int key = 0; key < Rows * Cols; key++) {
+            if (pressed & (KeyMask(1) << key))
+                _events.press(key, now_ms);
+        }
+
+        _events.tick(now_ms);
+
+        /** Keep scanning until every key has debounced back up */
+        _busy = raw != 0 || _debouncer.state() != 0;
+    }
+
+    /**
+     * @brief Takes the next key event.
+     *
+     * A ghosting pattern is reported once, as a '?' press,
+     * when it first appears.
+     *
+     * @return false if there is no event.
+     */
+    bool get(KeyEvent &event) {
+        if (_new_ghost) {
+            _new_ghost = false;
+            event.key = '?';
+            event.type = KEY_PRESS;
+            return true;
+        }
+
+        int key;
+        if (!_events.get(key, event.type))
+            return false;
+        event.key = _key_map[key / Cols][key % Cols];
+        return true;
+    }
+
+    /** @return the debounced state of all keys */
+    KeyMask held() const {
+        return _debouncer.state();
+    }
+
+    /**
+     * @brief Sets a function called from the column interrupt when
+     * an idle keypad sees a key go down.
+     */
+    void attach(Callback<void()> wake) {
+        _wake = wake;
+    }
+
+    /**
+     * @return true if update() has nothing to do until the next
+     * column interrupt: no key is held and no event is queued.
+     * Without interrupts the keypad is never idle.
+     */
+    bool idle() const {
+#if DEVICE_INTERRUPTIN
+        return !_activity && !_busy && !_new_ghost && !_events.active();
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @return us_ticker time of the column edge that started the
+     * latest press, or of its detection if the keypad was already
+     * being scanned.
+     */
+    uint32_t pressEdgeUs() const {
+        return _press_edge_us;
+    }
+
+    /** @return us_ticker time the latest press was debounced */
+    uint32_t pressDetectUs() const {
+        return _press_detect_us;
+    }
+
+    /** @return the typematic settings of this keypad */
+    KeyEvents &events() {
+        return _events;
+    }
+
+private:
+
+    /** @return mask of the rows from low up to, not including, high */
+    static KeyMask rowRange(int low, int high) {
+        KeyMask rows = 0;
+        for (int i = low; i < high; i++)
+            rows |= KeyMask(1) << i;
+        return rows;
+    }
+
+    /** Drives the rows in low_rows low and every other row high */
+    void drive(KeyMask low_rows) {
+        for (int i = 0; i < Rows; i++)
+            gpio_write(&_rows[i], (low_rows >> i) & 1 ? 0 : 1);
+    }
+
+    /** @return columns reading low once low_rows have settled */
+    int probe(KeyMask low_rows) {
+        drive(low_rows);
+        wait_us(_settle_us);
+        return readColumns();
+    }
+
+#if DEVICE_INTERRUPTIN
+    /** Column interrupt; wakes the scanner */
+    static void columnIrq(uintptr_t id, gpio_irq_event) {
+        MatrixKeypad *keypad = (MatrixKeypad *)id;
+        if (!keypad->_activity)
+            keypad->_edge_us = us_ticker_read();
+        keypad->_activity = true;
+        if (keypad->_wake)
+            keypad->_wake();
+    }
+#endif
+
+    /** @return bit mask of the columns reading low */
+    int readColumns() {
+        int pressed = 0;
+#if KEYPAD_PORT_READ
+        uint32_t values[Cols];
+        for (int p = 0; p < _num_ports; p++)
+            values[p] = port_read(&_ports[p]);
+        for (int i = 0; i < Cols; i++) {
+            if (!(values[_col_port[i]] & _col_bit[i]))
+                pressed |= 1 << i;
+        }
+#else
+        for (int i = 0; i < Cols; i++) {
+            if (gpio_read(&_cols[i]) == 0)
+                pressed |= 1 << i;
+        }
+#endif
+        return pressed;
+    }
+
+    const char (*_key_map)[Cols];
+    int _settle_us;
+
+    gpio_t _rows[Rows];
+#if KEYPAD_PORT_READ
+    port_t _ports[Cols];
+    PortName _port_names[Cols];
+    uint32_t _port_masks[Cols];
+    int _num_ports;
+    uint8_t _col_port[Cols];
+    uint32_t _col_bit[Cols];
+#else
+    gpio_t _cols[Cols];
+#endif
+
+#if DEVICE_INTERRUPTIN
+    gpio_irq_t _col_irqs[Cols];
+#endif
+
+    VerticalDebouncer<KeyMask> _debouncer;
+    KeyEvents _events;
+    Callback<void()> _wake;
+    bool _ghosted, _new_ghost;
+    volatile bool _activity;
+    bool _busy;
+
+    volatile uint32_t _edge_us;
+    uint32_t _wake_us;
+    bool _wake_valid;
+    uint32_t _press_edge_us, _press_detect_us;
+};
+
+#endif
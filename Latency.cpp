@@ -0,0 +1,143 @@
+/**
+ * @file Latency.cpp
+ *
+ * @brief Fixed-bucket latency histogram and idle-time meter.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Latency.h"
+#include <stdio.h>
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::add(uint32_t us) {
+    _counts[bucket(us)]++;
+    _count++;
+    if (us > _max)
+        _max = us;
+}
+
+void LatencyHistogram::reset() {
+    for (int i = 0; i < BUCKETS; i++)
+        _counts[i] = 0;
+    _count = 0;
+    _max = 0;
+}
+
+uint32_t LatencyHistogram::count() const {
+    return _count;
+}
+
+uint32_t LatencyHistogram::max() const {
+    return _max;
+}
+
+uint32_t LatencyHistogram::percentile(int percent) const {
+    if (_count == 0)
+        return 0;
+
+    /** Rank of the wanted sample, rounded up */
+    uint32_t rank = (uint64_t(_count) * percent + 99) / 100;
+    if (rank == 0)
+        rank = 1;
+
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += _counts[i];
+        if (seen >= rank)
+            return upperEdge(i) < _max ? upperEdge(i) : _max;
+    }
+    return _max;
+}
+
+void LatencyHistogram::print(const char *name) const {
+    printf("%s: n=%lu p50=%luus p99=%luus max=%luus\n", name,
+           (unsigned long)_count,
+           (unsigned long)percentile(50),
+           (unsigned long)percentile(99),
+           (unsigned long)_max);
+}
+
+/**
+ * Values below 4 get a bucket each. Above that, the top bit
+ * picks the power of two and the next two bits pick one of
+ * its four buckets.
+ */
+int LatencyHistogram::bucket(uint32_t us) {
+    if (us < 4)
+        return us;
+
+    int top = 31 - __builtin_clz(us);
+    int b = (top - 1)*4 + ((us >> (top - 2)) & 3);
+    return b < BUCKETS ? b : BUCKETS - 1;
+}
+
+uint32_t LatencyHistogram::upperEdge(int bucket) {
+    if (bucket < 4)
+        return bucket;
+
+    int top = bucket/4 + 1;
+    uint32_t low = uint32_t(4 + bucket % 4) << (top - 2);
+    return low + (uint32_t(1) << (top - 2)) - 1;
+}
+
+void KeyPathLatency::add(uint32_t edge, uint32_t detect, uint32_t dispatch, uint32_t render, uint32_t done) {
+    _debounce.add(detect - edge);
+    _dispatch.add(dispatch - detect);
+    _render.add(render - dispatch);
+    _bus.add(done - render);
+    _total.add(done - edge);
+}
+
+const LatencyHistogram &KeyPathLatency::total() const {
+    return _total;
+}
+
+void KeyPathLatency::print() const {
+    _debounce.print("edge->press");
+    _dispatch.print("press->dispatch");
+    _render.print("dispatch->render");
+    _bus.print("render->bus done");
+    _total.print("key->lcd");
+}
+
+IdleMeter::IdleMeter() {
+    reset();
+}
+
+void IdleMeter::begin(uint32_t now_us) {
+    if (_started)
+        _total_us += now_us - _last_us;
+    _last_us = now_us;
+    _started = true;
+}
+
+void IdleMeter::end(uint32_t now_us) {
+    uint32_t busy = now_us - _last_us;
+    _busy_us += busy;
+    _total_us += busy;
+    _last_us = now_us;
+}
+
+void IdleMeter::reset() {
+    _busy_us = 0;
+    _total_us = 0;
+    _last_us = 0;
+    _started = false;
+}
+
+int IdleMeter::idlePermille() const {
+    if (_total_us == 0)
+        return 1000;
+    return 1000 - int(_busy_us * 1000 / _total_us);
+}
+
+void IdleMeter::print(const char *name) const {
+    int idle = idlePermille();
+    printf("%s: %d.%d%% idle over %lu s\n", name, idle / 10, idle % 10,
+           (unsigned long)(_total_us / 1000000));
+}
@@ -0,0 +1,125 @@
+/**
+ * @file Latency.h
+ *
+ * @brief Fixed-bucket latency histogram used to time the
+ * path from a key press to the LCD, and a meter of the
+ * CPU's idle time.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+/**
+ * @brief Histogram of latencies in microseconds.
+ *
+ * Buckets are log-linear: every power of two is split into
+ * four buckets, so each bucket is at most 25% wide and the
+ * whole range up to about 30 s fits in 96 counters. Adding a sample
+ * is a few integer operations and never allocates.
+ */
+class LatencyHistogram {
+public:
+
+    /** Number of buckets; samples above the last one are clamped */
+    static const int BUCKETS = 96;
+
+    LatencyHistogram();
+
+    /** Adds one latency sample */
+    void add(uint32_t us);
+
+    /** Forgets every sample */
+    void reset();
+
+    /** @return number of samples added */
+    uint32_t count() const;
+
+    /** @return largest sample added */
+    uint32_t max() const;
+
+    /**
+     * @brief Finds a percentile of the samples.
+     *
+     * @param percent Percentile to find, 0-100
+     * @return upper edge of the bucket that holds it, in us
+     */
+    uint32_t percentile(int percent) const;
+
+    /** Prints count, p50, p99 and max on one line over the serial port */
+    void print(const char *name) const;
+
+private:
+    static int bucket(uint32_t us);
+    static uint32_t upperEdge(int bucket);
+
+    uint32_t _counts[BUCKETS];
+    uint32_t _count;
+    uint32_t _max;
+};
+
+/**
+ * @brief Latency of the path from a key press to the character
+ * being on the LCD, split into its stages.
+ *
+ * Stages are: column edge to debounced press, press to dispatch in
+ * the state machine, dispatch to the start of the LCD render, and
+ * render start to the last byte on the LCD bus.
+ */
+class KeyPathLatency {
+public:
+
+    /** Adds one key press; all times are us_ticker times */
+    void add(uint32_t edge, uint32_t detect, uint32_t dispatch, uint32_t render, uint32_t done);
+
+    /** @return the whole path, edge to last LCD byte */
+    const LatencyHistogram &total() const;
+
+    /** Prints every stage and the whole path, one line each */
+    void print() const;
+
+private:
+    LatencyHistogram _debounce, _dispatch, _render, _bus, _total;
+};
+
+/**
+ * @brief Share of time the CPU is idle, from the time spent in
+ * event handlers.
+ *
+ * begin() and end() go around each handler; whatever time passes
+ * outside them counts as idle, including time spent in interrupt
+ * handlers that the caller does not time. Times are us_ticker
+ * times, and two calls must come less than 71 minutes apart so
+ * the 32-bit differences do not wrap.
+ */
+class IdleMeter {
+public:
+
+    IdleMeter();
+
+    /** A handler starts */
+    void begin(uint32_t now_us);
+
+    /** The handler is done */
+    void end(uint32_t now_us);
+
+    /** Forgets the time measured so far */
+    void reset();
+
+    /** @return idle time in tenths of a percent of the time measured */
+    int idlePermille() const;
+
+    /** Prints the idle share over the serial port */
+    void print(const char *name) const;
+
+private:
+    uint64_t _busy_us, _total_us;
+    uint32_t _last_us;
+    bool _started;
+};
+
+#endif
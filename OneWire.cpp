@@ -0,0 +1,73 @@
+/**
+ * @file OneWire.cpp
+ *
+ * @brief Bit-banged 1-Wire bus master.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "OneWire.h"
+
+OneWire::OneWire(PinName pin) : _pin(pin) {
+    _pin.mode(OpenDrain);
+    _pin.output();
+    _pin.write(1);
+}
+
+bool OneWire::reset() {
+    _pin.write(0);
+    wait_us(480);
+
+    int presence;
+    {
+        CriticalSectionLock lock;
+        _pin.write(1);
+        wait_us(70);
+        presence = _pin.read() == 0;
+    }
+
+    wait_us(410);
+    return presence;
+}
+
+void OneWire::writeBit(int bit) {
+    CriticalSectionLock lock;
+    _pin.write(0);
+    if (bit) {
+        wait_us(6);
+        _pin.write(1);
+        wait_us(64);
+    }
+    else {
+        wait_us(60);
+        _pin.write(1);
+        wait_us(10);
+    }
+}
+
+int OneWire::readBit() {
+    int bit;
+    {
+        CriticalSectionLock lock;
+        _pin.write(0);
+        wait_us(6);
+        _pin.write(1);
+        wait_us(9);
+        bit = _pin.read();
+    }
+    wait_us(55);
+    return bit;
+}
+
+void OneWire::writeByte(uint8_t value) {
+    for (int i = 0; i < 8; i++)
+        writeBit((value >> i) & 1);
+}
+
+uint8_t OneWire::readByte() {
+    uint8_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= readBit() << i;
+    return value;
+}
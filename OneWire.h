@@ -0,0 +1,61 @@
+/**
+ * @file OneWire.h
+ *
+ * @brief Bit-banged 1-Wire bus master.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef ONEWIRE_H
+#define ONEWIRE_H
+
+#include "mbed.h"
+#include "OneWireCrc.h"
+
+/**
+ * @brief 1-Wire bus master on one open-drain GPIO pin.
+ *
+ * Every time slot is timed with wait_us() inside a critical
+ * section, so an interrupt cannot stretch it. A slot takes about
+ * 70 us and a reset about 1 ms; the interrupts are only held off
+ * for one slot at a time.
+ *
+ * The bus needs an external pull-up (4.7 k to 3.3 V).
+ *
+ * @code
+ * OneWire one_wire(PA_10);
+ * DS18B20Sensor<OneWire> probe(one_wire);
+ * @endcode
+ */
+class OneWire {
+public:
+
+    /**
+     * @param pin Pin wired to the bus data line
+     */
+    OneWire(PinName pin);
+
+    /**
+     * @brief Sends a reset pulse.
+     *
+     * @return true if a device answered with a presence pulse.
+     */
+    bool reset();
+
+    void writeBit(int bit);
+    int readBit();
+
+    void writeByte(uint8_t value);
+    uint8_t readByte();
+
+    /** @return Dallas/Maxim CRC-8 of data; 0 over data plus its CRC byte */
+    static uint8_t crc8(const uint8_t *data, int length) {
+        return oneWireCrc8(data, length);
+    }
+
+private:
+    DigitalInOut _pin;
+};
+
+#endif
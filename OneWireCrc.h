@@ -0,0 +1,38 @@
+/**
+ * @file OneWireCrc.h
+ *
+ * @brief Dallas/Maxim CRC-8 used by 1-Wire ROM codes and
+ * scratchpads.
+ *
+ * This header has no mbed dependencies so the same code
+ * runs on the device and on a host computer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef ONEWIRECRC_H
+#define ONEWIRECRC_H
+
+#include <stdint.h>
+
+/**
+ * @return Dallas/Maxim CRC-8 (polynomial x^8 + x^5 + x^4 + 1) of
+ * data; 0 over data followed by its CRC byte
+ */
+inline uint8_t oneWireCrc8(const uint8_t *data, int length) {
+    uint8_t crc = 0;
+    for (int i = 0; i < length; i++) {
+        uint8_t byte = data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t mix = (crc ^ byte) & 1;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            byte >>= 1;
+        }
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,220 @@
+/**
+ * @file SerialCommand.cpp
+ *
+ * @brief Line based command protocol for the serial port: the
+ * incremental parser and the commands, shared by the device and
+ * the host stand-in.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "SerialCommand.h"
+#include "Calendar.h"
+#include "TimeZone.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+CommandParser::CommandParser() : _length(0), _argc(0), _overflow(false), _overflowed(false) {}
+
+bool CommandParser::feed(char c) {
+    if (c == '\r' || c == '\n') {
+        bool ended = _length > 0 || _overflow;
+        _overflowed = _overflow;
+        _overflow = false;
+        _argc = 0;
+        if (ended && !_overflowed)
+            split();
+        _length = 0;
+        return ended;
+    }
+
+    if (_length < MAX_LINE)
+        _line[_length++] = c;
+    else
+        _overflow = true;
+    return false;
+}
+
+void CommandParser::split() {
+    _line[_length] = '\0';
+    char *p = _line;
+    for (;;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0')
+            return;
+        _argv[_argc++] = p;
+        if (_argc == MAX_ARGS)
+            return;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+        if (*p == '\0')
+            return;
+        *p++ = '\0';
+    }
+}
+
+/** @return true if two words match, ignoring case */
+static bool sameWord(const char *a, const char *b) {
+    for (; *a && *b; a++, b++) {
+        char x = *a >= 'a' && *a <= 'z' ? *a - 32 : *a;
+        char y = *b >= 'a' && *b <= 'z' ? *b - 32 : *b;
+        if (x != y)
+            return false;
+    }
+    return *a == *b;
+}
+
+const Command *findCommand(const Command *commands, int count, const char *name) {
+    for (int i = 0; i < count; i++)
+        if (sameWord(commands[i].name, name))
+            return &commands[i];
+    return NULL;
+}
+
+bool parseNumber(const char *word, int64_t &value) {
+    bool negative = *word == '-';
+    if (*word == '-' || *word == '+')
+        word++;
+    if (*word == '\0')
+        return false;
+
+    value = 0;
+    for (; *word; word++) {
+        if (*word < '0' || *word > '9' || value > 99999999999LL)
+            return false;
+        value = value*10 + (*word - '0');
+    }
+    if (negative)
+        value = -value;
+    return true;
+}
+
+/** Formats a reply and sends it through the target */
+static void reply(CommandTarget &target, const char *format, ...) {
+    char text[128];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length > int(sizeof(text)) - 1)
+        length = sizeof(text) - 1;
+    if (length > 0)
+        target.write(text, length);
+}
+
+/** TIME [seconds]: prints, or sets, the clock in UTC seconds since 1970 */
+static void cmdTime(CommandTarget &target, int argc, const char *const *argv) {
+    if (argc > 1) {
+        int64_t seconds;
+        if (!parseNumber(argv[1], seconds) || seconds < 0) {
+            reply(target, "ERR bad time\n");
+            return;
+        }
+        target.setTime(seconds);
+        reply(target, "OK\n");
+        return;
+    }
+
+    time_t utc = target.now();
+    LocalTime &local_time = target.localTime();
+    DateTime date;
+    dateTimeFromTime(local_time.toLocal(utc), date);
+    reply(target, "TIME %lld %04d-%02d-%02d %02d:%02d:%02d %s\n", (long long)utc,
+          date.year, date.month, date.day, date.hour, date.minute, date.second,
+          local_time.abbreviation());
+}
+
+/** ZONE [index]: prints, or selects, the time zone */
+static void cmdZone(CommandTarget &target, int argc, const char *const *argv) {
+    if (argc > 1) {
+        int64_t zone;
+        if (!parseNumber(argv[1], zone) || zone < 0 || zone >= timeZoneCount()) {
+            reply(target, "ERR bad zone\n");
+            return;
+        }
+        target.setZone(zone);
+        reply(target, "OK\n");
+        return;
+    }
+    const LocalTime &local_time = target.localTime();
+    reply(target, "ZONE %d %s\n", local_time.zoneIndex(), local_time.zone().name);
+}
+
+/** TEMP: latest reading in tenths of a degree C, readings taken and errors */
+static void cmdTemp(CommandTarget &target, int, const char *const *) {
+    TempStatus status = target.temp();
+    reply(target, "TEMP %d %lu %lu\n", status.tenths_c,
+          (unsigned long)status.count, (unsigned long)status.errors);
+}
+
+/** STATS: 24 hour low, high and mean in tenths of a degree C, samples, trend per hour */
+static void cmdStats(CommandTarget &target, int, const char *const *) {
+    StatsStatus stats;
+    if (!target.stats(stats)) {
+        reply(target, "STATS none\n");
+        return;
+    }
+    reply(target, "STATS %d %d %d %d %d\n", stats.min, stats.max, stats.mean, stats.count, stats.trend);
+}
+
+/** PERF: idle share, p99 latencies in us and dropped counters */
+static void cmdPerf(CommandTarget &target, int, const char *const *) {
+    PerfStatus perf = target.perf();
+    reply(target, "PERF idle=%d key_p99=%lu second_p99=%lu late=%lu skipped=%lu rx_dropped=%lu tx_dropped=%lu\n",
+          perf.idle_permille,
+          (unsigned long)perf.key_p99_us,
+          (unsigned long)perf.second_p99_us,
+          (unsigned long)perf.late_seconds,
+          (unsigned long)perf.skipped_hundredths,
+          (unsigned long)perf.rx_dropped,
+          (unsigned long)perf.tx_dropped);
+}
+
+/** REPORT: the full report that long-press 'D' prints */
+static void cmdReport(CommandTarget &target, int, const char *const *) {
+    target.report();
+    reply(target, "OK\n");
+}
+
+static void cmdHelp(CommandTarget &target, int, const char *const *);
+
+static const Command commands[] = {
+        {"TIME", 0, 1, "TIME [seconds]", cmdTime},
+        {"ZONE", 0, 1, "ZONE [index]", cmdZone},
+        {"TEMP", 0, 0, "TEMP", cmdTemp},
+        {"STATS", 0, 0, "STATS", cmdStats},
+        {"PERF", 0, 0, "PERF", cmdPerf},
+        {"REPORT", 0, 0, "REPORT", cmdReport},
+        {"HELP", 0, 0, "HELP", cmdHelp},
+};
+
+static const int COMMAND_COUNT = sizeof(commands) / sizeof(commands[0]);
+
+/** HELP: lists the commands */
+static void cmdHelp(CommandTarget &target, int, const char *const *) {
+    for (int i = 0; i < COMMAND_COUNT; i++)
+        reply(target, "%s\n", commands[i].usage);
+    reply(target, "OK\n");
+}
+
+void runCommand(const CommandParser &parser, CommandTarget &target) {
+    if (parser.overflowed()) {
+        reply(target, "ERR line too long\n");
+        return;
+    }
+    if (parser.argc() == 0)
+        return;
+
+    int argc = parser.argc();
+    const char *const *argv = parser.argv();
+    const Command *command = findCommand(commands, COMMAND_COUNT, argv[0]);
+    if (command == NULL)
+        reply(target, "ERR unknown command\n");
+    else if (argc - 1 < command->min_args || argc - 1 > command->max_args)
+        reply(target, "ERR usage: %s\n", command->usage);
+    else
+        command->run(target, argc, argv);
+}
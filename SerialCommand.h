@@ -0,0 +1,291 @@
+/**
+ * @file SerialCommand.h
+ *
+ * @brief Line based command protocol for the serial port: a
+ * receive ring filled by the UART interrupt, an incremental
+ * parser that takes bytes as they come, the command table and
+ * the transmit queue.
+ *
+ * This header has no mbed dependencies so the same parser and
+ * commands run on the device and on a host computer, e.g. behind
+ * a pty.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef SERIALCOMMAND_H
+#define SERIALCOMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+class LocalTime;
+
+/**
+ * @brief Byte ring with one writer and one reader.
+ *
+ * The UART interrupt pushes and the event queue pops. Each side
+ * only writes its own index, so no lock is needed. A byte that
+ * finds the ring full is dropped and counted.
+ *
+ * @tparam Size Capacity plus one, a power of two
+ */
+template<int Size>
+class ByteRing {
+public:
+
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "size must be a power of two");
+
+    ByteRing() : _head(0), _tail(0), _dropped(0) {}
+
+    /** @return false if the ring was full and the byte was dropped */
+    bool push(char c) {
+        unsigned head = _head;
+        unsigned next = (head + 1) & (Size - 1);
+        if (next == _tail) {
+            _dropped++;
+            return false;
+        }
+        _data[head] = c;
+        _head = next;
+        return true;
+    }
+
+    /** @return false if the ring is empty */
+    bool pop(char &c) {
+        unsigned tail = _tail;
+        if (tail == _head)
+            return false;
+        c = _data[tail];
+        _tail = (tail + 1) & (Size - 1);
+        return true;
+    }
+
+    /** @return number of bytes dropped because the ring was full */
+    uint32_t dropped() const {
+        return _dropped;
+    }
+
+private:
+    char _data[Size];
+    volatile unsigned _head, _tail;
+    volatile uint32_t _dropped;
+};
+
+/**
+ * @brief Transmit side of an interrupt driven UART.
+ *
+ * write() copies the bytes into a ring and turns the transmit
+ * interrupt on; irq() sends a byte each time the port is ready and
+ * turns itself off once the ring is empty. A byte that finds the
+ * ring full is dropped and counted instead of blocking the caller.
+ *
+ * @tparam Size Ring size, a power of two
+ * @tparam Port Copyable handle with writeable(), send(char) and
+ *              enable(bool), which attaches or detaches the
+ *              transmit interrupt that calls irq()
+ * @tparam Lock Disables interrupts for its lifetime, like
+ *              CriticalSectionLock
+ */
+template<int Size, typename Port, typename Lock>
+class TxQueue {
+public:
+
+    explicit TxQueue(const Port &port) : _port(port), _sending(false) {}
+
+    /** Queues bytes and starts the transmit interrupt if it is off */
+    void write(const char *bytes, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            _ring.push(bytes[i]);
+
+        /**
+         * irq() clears _sending after it finds the ring empty, so
+         * checking it with interrupts off cannot miss the bytes
+         * just pushed.
+         */
+        Lock lock;
+        if (!_sending) {
+            _sending = true;
+            _port.enable(true);
+        }
+    }
+
+    /** Transmit interrupt: sends while the port has room */
+    void irq() {
+        char c;
+        while (_port.writeable()) {
+            if (!_ring.pop(c)) {
+                _port.enable(false);
+                _sending = false;
+                return;
+            }
+            _port.send(c);
+        }
+    }
+
+    /** @return true while the transmit interrupt is attached */
+    bool sending() const {
+        return _sending;
+    }
+
+    /** @return number of bytes dropped because the ring was full */
+    uint32_t dropped() const {
+        return _ring.dropped();
+    }
+
+private:
+    Port _port;
+    ByteRing<Size> _ring;
+    volatile bool _sending;
+};
+
+/**
+ * @brief Splits incoming bytes into command lines and words.
+ *
+ * feed() takes one byte at a time and does a few compares per
+ * byte, so a command never has to arrive in one piece. A line
+ * ends at CR or LF and empty lines are skipped. Words are split
+ * at spaces and tabs. A line longer than MAX_LINE is thrown away
+ * up to its end and reported as overflowed.
+ *
+ * @code
+ * CommandParser parser;
+ * if (parser.feed(c))
+ *     runCommand(parser, target);
+ * @endcode
+ */
+class CommandParser {
+public:
+
+    /** Longest line, in characters */
+    static const int MAX_LINE = 63;
+
+    /** Most words in a line; extra words stay in the last one */
+    static const int MAX_ARGS = 6;
+
+    CommandParser();
+
+    /**
+     * @brief Takes the next byte.
+     *
+     * @return true if the byte ended a line; its words are then
+     * in argc() and argv() until the next call
+     */
+    bool feed(char c);
+
+    int argc() const {
+        return _argc;
+    }
+
+    const char *const *argv() const {
+        return _argv;
+    }
+
+    /** @return true if the line just ended was too long and was dropped */
+    bool overflowed() const {
+        return _overflowed;
+    }
+
+private:
+
+    /** Splits the line in place */
+    void split();
+
+    char _line[MAX_LINE + 1];
+    const char *_argv[MAX_ARGS];
+    int _length, _argc;
+    bool _overflow, _overflowed;
+};
+
+/** Latest reading of the first temperature sensor, for TEMP */
+struct TempStatus {
+    int tenths_c;
+    uint32_t count;     /**< readings taken */
+    uint32_t errors;
+};
+
+/** 24 hour temperature statistics in tenths of a degree C, for STATS */
+struct StatsStatus {
+    int min, max, mean;
+    int count;          /**< readings in the window */
+    int trend;          /**< change per hour */
+};
+
+/** Performance counters, for PERF */
+struct PerfStatus {
+    int idle_permille;
+    uint32_t key_p99_us, second_p99_us;
+    uint32_t late_seconds, skipped_hundredths;
+    uint32_t rx_dropped, tx_dropped;
+};
+
+/**
+ * @brief What the commands read and change.
+ *
+ * The command table, the argument checks and every reply format
+ * live in SerialCommand.cpp; the device and the host stand-in each
+ * implement these hooks, so both answer exactly alike.
+ */
+class CommandTarget {
+public:
+    virtual ~CommandTarget() {}
+
+    /** Sends reply text */
+    virtual void write(const char *text, size_t length) = 0;
+
+    /** @return the clock in UTC seconds since 1970 */
+    virtual time_t now() = 0;
+
+    /** Sets the clock, in UTC seconds since 1970 */
+    virtual void setTime(time_t utc) = 0;
+
+    /** @return the time zone the clock shows */
+    virtual LocalTime &localTime() = 0;
+
+    /** Selects the time zone, an index already checked against timeZoneCount() */
+    virtual void setZone(int zone) = 0;
+
+    virtual TempStatus temp() = 0;
+
+    /** @return false if there are no readings yet */
+    virtual bool stats(StatsStatus &stats) = 0;
+
+    virtual PerfStatus perf() = 0;
+
+    /** Prints the full report; the command adds the closing OK */
+    virtual void report() = 0;
+};
+
+/** A command of the protocol */
+struct Command {
+    const char *name;
+    int min_args, max_args;     /**< words after the name */
+    const char *usage;
+    void (*run)(CommandTarget &target, int argc, const char *const *argv);
+};
+
+/**
+ * @brief Runs the line the parser just finished: looks the command
+ * up, checks its argument count and replies through the target.
+ *
+ * Call it each time CommandParser::feed() returns true.
+ */
+void runCommand(const CommandParser &parser, CommandTarget &target);
+
+/**
+ * @brief Looks up the first word of a line, case blind.
+ *
+ * @return the command, NULL if there is none by that name
+ */
+const Command *findCommand(const Command *commands, int count, const char *name);
+
+/**
+ * @brief Reads a whole decimal number, with an optional sign.
+ *
+ * @return false if the word is not a number
+ */
+bool parseNumber(const char *word, int64_t &value);
+
+#endif
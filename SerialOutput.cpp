@@ -0,0 +1,54 @@
+/**
+ * @file SerialOutput.cpp
+ *
+ * @brief Console output that queues bytes in a ring and sends
+ * them from the UART transmit interrupt, so printf() never waits
+ * for the serial line.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "SerialOutput.h"
+
+SerialOutput::SerialOutput(UnbufferedSerial &serial) : _serial(serial), _queue(Port(this)) {}
+
+ssize_t SerialOutput::write(const void *buffer, size_t size) {
+    _queue.write(static_cast<const char *>(buffer), size);
+    return size;
+}
+
+void SerialOutput::txIrq() {
+    _queue.irq();
+}
+
+bool SerialOutput::Port::writeable() {
+    return _output->_serial.writeable();
+}
+
+void SerialOutput::Port::send(char c) {
+    _output->_serial.write(&c, 1);
+}
+
+void SerialOutput::Port::enable(bool on) {
+    if (on)
+        _output->_serial.attach(callback(_output, &SerialOutput::txIrq), SerialBase::TxIrq);
+    else
+        _output->_serial.attach(nullptr, SerialBase::TxIrq);
+}
+
+ssize_t SerialOutput::read(void *buffer, size_t size) {
+    return _serial.read(buffer, size);
+}
+
+off_t SerialOutput::seek(off_t, int) {
+    return -ESPIPE;
+}
+
+int SerialOutput::close() {
+    return 0;
+}
+
+int SerialOutput::isatty() {
+    return 1;
+}
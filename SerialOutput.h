@@ -0,0 +1,76 @@
+/**
+ * @file SerialOutput.h
+ *
+ * @brief Console output that queues bytes in a ring and sends
+ * them from the UART transmit interrupt, so printf() never waits
+ * for the serial line.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef SERIALOUTPUT_H
+#define SERIALOUTPUT_H
+
+#include "mbed.h"
+#include "SerialCommand.h"
+
+/**
+ * @brief A FileHandle for the console whose writes return at once.
+ *
+ * write() hands the bytes to a TxQueue, which sends them from the
+ * UART's transmit interrupt. At 115200 baud a byte takes 87 us on
+ * the line but only an interrupt of a few microseconds on the CPU.
+ * A byte that finds the ring full is dropped and counted instead
+ * of blocking the caller.
+ *
+ * Reads go straight to the serial port.
+ *
+ * @code
+ * UnbufferedSerial serial(USBTX, USBRX, 115200);
+ * SerialOutput output(serial);
+ * FileHandle *mbed::mbed_override_console(int) { return &output; }
+ * @endcode
+ */
+class SerialOutput : public FileHandle {
+public:
+
+    /** Ring size; holds a whole long-press 'D' report */
+    static const int BUFFER_SIZE = 4096;
+
+    /** @param serial Port to send through; its RX interrupt is left alone */
+    SerialOutput(UnbufferedSerial &serial);
+
+    virtual ssize_t write(const void *buffer, size_t size);
+    virtual ssize_t read(void *buffer, size_t size);
+    virtual off_t seek(off_t offset, int whence = SEEK_SET);
+    virtual int close();
+    virtual int isatty();
+
+    /** @return number of bytes dropped because the ring was full */
+    uint32_t dropped() const {
+        return _queue.dropped();
+    }
+
+private:
+
+    /** The UART's transmit side, as TxQueue sees it */
+    class Port {
+    public:
+        explicit Port(SerialOutput *output) : _output(output) {}
+        bool writeable();
+        void send(char c);
+        void enable(bool on);
+
+    private:
+        SerialOutput *_output;
+    };
+
+    /** Transmit interrupt */
+    void txIrq();
+
+    UnbufferedSerial &_serial;
+    TxQueue<BUFFER_SIZE, Port, CriticalSectionLock> _queue;
+};
+
+#endif
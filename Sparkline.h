@@ -0,0 +1,121 @@
+/**
+ * @file Sparkline.h
+ *
+ * @brief One-row bar graph of recent samples for a character LCD.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef SPARKLINE_H
+#define SPARKLINE_H
+
+#include <stdint.h>
+
+/** Pixel rows of one HD44780 character cell */
+const int SPARK_ROWS = 8;
+
+/** Bar glyphs needed in CGRAM: heights 1 to 7 rows */
+const int SPARK_GLYPHS = SPARK_ROWS - 1;
+
+/**
+ * @brief Bar graph of the last Cells samples, one character
+ * cell per sample.
+ *
+ * Bars are quantized to nine heights: an empty cell is a space,
+ * a full cell is the ROM's solid block (0xFF), and the seven
+ * heights in between come from SPARK_GLYPHS CGRAM characters. The
+ * bar set never changes, so the glyphs are uploaded once and a new
+ * sample costs no CGRAM writes at all. Shifting the graph only
+ * changes the character codes of the cells, and an LCD that skips
+ * unchanged characters sends just the cells whose bar height moved.
+ *
+ * The graph is scaled to the lowest and highest sample shown,
+ * spanning at least min_span so noise does not fill the cell.
+ *
+ * @tparam Cells Samples (and character cells) in the graph
+ */
+template<int Cells>
+class Sparkline {
+public:
+
+    /**
+     * @param min_span Smallest value range drawn over the full height
+     */
+    Sparkline(int min_span = 10) : _min_span(min_span), _next(0), _count(0) {}
+
+    /** Adds a sample, dropping the oldest one once the graph is full */
+    void add(int16_t value) {
+        _samples[_next] = value;
+        _next = _next + 1 == Cells ? 0 : _next + 1;
+        if (_count < Cells)
+            _count++;
+    }
+
+    /** @return number of samples in the graph */
+    int count() const {
+        return _count;
+    }
+
+    /**
+     * @brief Character codes of the graph, oldest sample on the left
+     * and the newest on the right.
+     *
+     * @param cells      Cells characters
+     * @param first_bar  CGRAM character holding the 1 row bar; the
+     *                   following ones hold 2 to 7 rows
+     */
+    void render(char *cells, int first_bar) const {
+        int low = 0, high = 0;
+        for (int i = 0; i < _count; i++) {
+            int16_t value = sample(i);
+            if (i == 0 || value < low)
+                low = value;
+            if (i == 0 || value > high)
+                high = value;
+        }
+
+        /** Center the data in the smallest span */
+        int span = high - low;
+        if (span < _min_span) {
+            low -= (_min_span - span) / 2;
+            span = _min_span;
+        }
+
+        for (int i = 0; i < Cells; i++) {
+            int empty = Cells - _count;
+            if (i < empty) {
+                cells[i] = ' ';
+                continue;
+            }
+
+            /** Every sample gets at least one row so the graph stays visible */
+            int height = 1 + (sample(i - empty) - low) * (SPARK_ROWS - 1) / span;
+            cells[i] = height >= SPARK_ROWS ? char(0xFF) : char(first_bar + height - 1);
+        }
+    }
+
+    /**
+     * @brief CGRAM pattern of a bar.
+     *
+     * @param height  Rows lit, from the bottom (1 to SPARK_GLYPHS)
+     * @param pattern Set to 8 rows of 5 pixels, top row first
+     */
+    static void barPattern(int height, char *pattern) {
+        for (int row = 0; row < SPARK_ROWS; row++)
+            pattern[row] = row >= SPARK_ROWS - height ? 0x1F : 0x00;
+    }
+
+private:
+    /** @return the i-th sample in the graph, 0 being the oldest */
+    int16_t sample(int i) const {
+        int pos = _next - _count + i;
+        return _samples[pos < 0 ? pos + Cells : pos];
+    }
+
+    int _min_span;
+    int16_t _samples[Cells];
+    int _next, _count;
+};
+
+#endif
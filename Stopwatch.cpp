@@ -0,0 +1,82 @@
+/**
+ * @file Stopwatch.cpp
+ *
+ * @brief Stopwatch and countdown timer with hundredths of a
+ * second, kept by a hardware timer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Stopwatch.h"
+
+/** Microseconds in one hundredth of a second */
+static const int64_t TICK_US = 10000;
+
+Stopwatch::Stopwatch() : _running(false), _countdown(0) {}
+
+void Stopwatch::start() {
+    _timer.start();
+    _running = true;
+}
+
+void Stopwatch::stop() {
+    _timer.stop();
+    _running = false;
+}
+
+void Stopwatch::reset() {
+    stop();
+    _timer.reset();
+}
+
+void Stopwatch::setCountdown(uint32_t hundredths) {
+    _countdown = hundredths;
+    reset();
+}
+
+int64_t Stopwatch::shownUs() {
+    int64_t elapsed = _timer.elapsed_time().count();
+    if (_countdown == 0)
+        return elapsed;
+
+    int64_t left = _countdown*TICK_US - elapsed;
+    return left > 0 ? left : 0;
+}
+
+uint32_t Stopwatch::hundredths() {
+    int64_t us = shownUs();
+    int64_t value = _countdown ? (us + TICK_US - 1) / TICK_US : us / TICK_US;
+    return value > MAX_HUNDREDTHS ? MAX_HUNDREDTHS : uint32_t(value);
+}
+
+bool Stopwatch::expired() {
+    return _countdown != 0 && shownUs() == 0;
+}
+
+bool Stopwatch::full() {
+    return _countdown == 0 && shownUs() >= int64_t(MAX_HUNDREDTHS)*TICK_US;
+}
+
+uint32_t Stopwatch::untilChange() {
+    int64_t us = shownUs();
+    if (_countdown == 0)
+        return TICK_US - us % TICK_US;
+
+    /** Shown rounded up, so it changes when the time left crosses a tick */
+    int64_t rest = us % TICK_US;
+    return rest ? rest : TICK_US;
+}
+
+void Stopwatch::format(uint32_t hundredths, char *text) {
+    uint32_t seconds = hundredths / 100;
+    text[0] = '0' + seconds / 600;
+    text[1] = '0' + seconds / 60 % 10;
+    text[2] = ':';
+    text[3] = '0' + seconds % 60 / 10;
+    text[4] = '0' + seconds % 10;
+    text[5] = '.';
+    text[6] = '0' + hundredths % 100 / 10;
+    text[7] = '0' + hundredths % 10;
+    text[8] = '\0';
+}
@@ -0,0 +1,109 @@
+/**
+ * @file Stopwatch.h
+ *
+ * @brief Stopwatch and countdown timer with hundredths of a
+ * second, kept by a hardware timer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef STOPWATCH_H
+#define STOPWATCH_H
+
+#include "mbed.h"
+#include <stdint.h>
+
+/**
+ * @brief Counts up from zero, or down from a set time, on an mbed
+ * Timer.
+ *
+ * The time lives in the Timer, which runs on the microsecond
+ * ticker, so it stays exact however seldom it is read. The display
+ * can skip as many frames as it must without losing time.
+ *
+ * Times are shown to the hundredth, not the millisecond. MM:SS.hh
+ * already takes half of the LCD's 16 columns, a frame each
+ * millisecond would keep the LCD bus busy most of the time, and
+ * the liquid crystal takes far longer than a millisecond to change,
+ * so a thousandths digit would only show as a blur. The Timer still
+ * counts microseconds; only the display is rounded.
+ *
+ * Counting up stops at MAX_HUNDREDTHS. The caller stops the
+ * stopwatch once full() is true, so the display does not keep
+ * redrawing the same time.
+ *
+ * @code
+ * Stopwatch stopwatch;
+ * stopwatch.setCountdown(5*6000);     // 5 minutes
+ * stopwatch.start();
+ * char text[9];
+ * Stopwatch::format(stopwatch.hundredths(), text);
+ * @endcode
+ */
+class Stopwatch {
+public:
+
+    /** Largest time shown, 99:59.99 */
+    static const uint32_t MAX_HUNDREDTHS = 100*60*100 - 1;
+
+    Stopwatch();
+
+    void start();
+
+    void stop();
+
+    /** @brief Stops and goes back to zero, or to the countdown time */
+    void reset();
+
+    /**
+     * @brief Counts down from a time instead of up from zero.
+     * Also resets.
+     *
+     * @param hundredths Time to count down from, 0 to count up
+     */
+    void setCountdown(uint32_t hundredths);
+
+    bool running() const {
+        return _running;
+    }
+
+    /** @return true if counting down */
+    bool countdown() const {
+        return _countdown != 0;
+    }
+
+    /**
+     * @return the time to show in hundredths of a second: the time
+     * counted up, or the time left rounded up so a countdown only
+     * shows zero once it is over
+     */
+    uint32_t hundredths();
+
+    /** @return true if a countdown has reached zero */
+    bool expired();
+
+    /** @return true if counting up and the time shown has reached MAX_HUNDREDTHS */
+    bool full();
+
+    /** @return microseconds until hundredths() next changes */
+    uint32_t untilChange();
+
+    /**
+     * @brief Writes a time as MM:SS.hh.
+     *
+     * @param text At least 9 characters
+     */
+    static void format(uint32_t hundredths, char *text);
+
+private:
+
+    /** @return microseconds counted up, or left to count down */
+    int64_t shownUs();
+
+    Timer _timer;
+    bool _running;
+    uint32_t _countdown;
+};
+
+#endif
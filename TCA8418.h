@@ -0,0 +1,248 @@
+/**
+ * @file TCA8418.h
+ *
+ * @brief Keypad backend for the TCA8418 I2C keypad
+ * scanner chip.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TCA8418_H
+#define TCA8418_H
+
+#include "KeyEvents.h"
+#include <stdint.h>
+
+/**
+ * @brief Reads a matrix keypad through a TCA8418 scanner chip.
+ *
+ * The chip scans and debounces the matrix on its own and queues
+ * press and release events in a 10 entry FIFO. When its INT line
+ * goes low the whole FIFO is read in one burst (auto-increment
+ * off, so every byte pops the next event) and the events are fed
+ * into the same KeyEvents typematic that MatrixKeypad uses.
+ *
+ * It has the same interface as MatrixKeypad, so the application
+ * can use either one. The header has no mbed dependencies; the
+ * bus, the INT pin, the clock and the callback type all come in
+ * through the template parameters.
+ *
+ * @code
+ * I2C i2c(PB_9, PB_8);
+ * InterruptIn keypad_int(PB_5, PullUp);
+ * TCA8418Keypad<4, 4, I2C, InterruptIn, MbedKeypadPlatform> keypad(i2c, keypad_int, key_map);
+ * @endcode
+ *
+ * @tparam Bus      I2C master with mbed's I2C read() and write()
+ * @tparam Irq      Input with read() and fall(Handler), like InterruptIn
+ * @tparam Platform Provides the Handler callback type, built from an
+ *                  object and a member function, and a static
+ *                  nowUs() microsecond clock, like MbedKeypadPlatform
+ */
+template<int Rows, int Cols, typename Bus, typename Irq, typename Platform>
+class TCA8418Keypad {
+public:
+
+    static_assert(Rows <= 8 && Cols <= 10, "the TCA8418 scans at most 8 rows and 10 columns");
+
+    /** Callback type of the INT interrupt and of attach() */
+    typedef typename Platform::Handler Handler;
+
+    /** 8-bit I2C address of the chip */
+    static const int ADDRESS = 0x34 << 1;
+
+    /**
+     * @param i2c     I2C bus the chip is on
+     * @param irq     Input wired to the chip's INT output, pulled up
+     * @param key_map Character reported for each key
+     */
+    TCA8418Keypad(Bus &i2c, Irq &irq, const char (&key_map)[Rows][Cols]) :
+            _i2c(i2c), _irq(irq), _key_map(key_map), _pending(true),
+            _edge_us(0), _press_edge_us(0), _press_detect_us(0), _overflows(0) {
+
+        /** Use rows R0.. and columns C0.. as the key matrix */
+        uint32_t cols = (1u << Cols) - 1;
+        writeRegister(KP_GPIO1, (1u << Rows) - 1);
+        writeRegister(KP_GPIO2, cols & 0xFF);
+        writeRegister(KP_GPIO3, cols >> 8);
+
+        /** Key event and overflow interrupts; FIFO reads pop in place */
+        writeRegister(CFG, CFG_KE_IEN | CFG_OVR_FLOW_IEN | CFG_INT_CFG);
+        writeRegister(INT_STAT, INT_K_INT | INT_OVR_FLOW);
+
+        _irq.fall(Handler(this, &TCA8418Keypad::irqFall));
+    }
+
+    /**
+     * @brief Drains the chip's event FIFO if INT is asserted
+     * and queues the resulting key events.
+     *
+     * @param now_ms Milliseconds from a free-running clock.
+     */
+    void update(uint32_t now_ms) {
+        /** INT stays low while events are queued */
+        if (_pending || _irq.read() == 0) {
+            _pending = false;
+            drain(now_ms);
+        }
+        _events.tick(now_ms);
+    }
+
+    /**
+     * @brief Takes the next key event.
+     *
+     * @return false if there is no event.
+     */
+    bool get(KeyEvent &event) {
+        int key;
+        if (!_events.get(key, event.type))
+            return false;
+        event.key = _key_map[key / Cols][key % Cols];
+        return true;
+    }
+
+    /** @return Platform::nowUs() time of the INT edge that reported the latest press */
+    uint32_t pressEdgeUs() const {
+        return _press_edge_us;
+    }
+
+    /** @return Platform::nowUs() time the latest press was read from the chip */
+    uint32_t pressDetectUs() const {
+        return _press_detect_us;
+    }
+
+    /**
+     * @brief Sets a function called from the INT interrupt when
+     * the chip has queued events.
+     */
+    void attach(Handler wake) {
+        _wake = wake;
+    }
+
+    /**
+     * @return true if update() has nothing to do until the next
+     * INT edge: the FIFO is empty and no key is held.
+     */
+    bool idle() {
+        return !_pending && _irq.read() == 1 && !_events.active();
+    }
+
+    /** @return times the chip's FIFO overflowed and events were lost */
+    int overflows() const {
+        return _overflows;
+    }
+
+    /** @return the typematic settings of this keypad */
+    KeyEvents &events() {
+        return _events;
+    }
+
+private:
+
+    /** Register map */
+    enum {
+        CFG = 0x01,
+        INT_STAT = 0x02,
+        KEY_LCK_EC = 0x03,
+        KEY_EVENT_A = 0x04,
+        KP_GPIO1 = 0x1D,
+        KP_GPIO2 = 0x1E,
+        KP_GPIO3 = 0x1F,
+    };
+
+    enum {
+        CFG_KE_IEN = 0x01,
+        CFG_OVR_FLOW_IEN = 0x08,
+        CFG_INT_CFG = 0x10,
+        INT_K_INT = 0x01,
+        INT_OVR_FLOW = 0x08,
+        FIFO_SIZE = 10,
+    };
+
+    void irqFall() {
+        _edge_us = Platform::nowUs();
+        _pending = true;
+        if (_wake)
+            _wake();
+    }
+
+    /** Reads every queued event in one burst and clears the interrupt */
+    void drain(uint32_t now_ms) {
+        int status = readRegister(INT_STAT);
+        if (status < 0)
+            return;
+
+        if (status & INT_OVR_FLOW)
+            _overflows++;
+
+        int count = readRegister(KEY_LCK_EC);
+        if (count > 0) {
+            char fifo[FIFO_SIZE];
+            count &= 0x0F;
+            if (count > FIFO_SIZE)
+                count = FIFO_SIZE;
+
+            if (readRegisters(KEY_EVENT_A, fifo, count) == 0) {
+                uint32_t now_us = Platform::nowUs();
+                for (int i = 0; i < count; i++)
+                    keyEvent(fifo[i], now_ms, now_us);
+            }
+        }
+
+        writeRegister(INT_STAT, status & (INT_K_INT | INT_OVR_FLOW));
+    }
+
+    /**
+     * Event bytes hold the key number, row*10 + col + 1, and
+     * bit 7 set for a press. GPI events and keys outside the
+     * matrix are ignored.
+     */
+    void keyEvent(char event, uint32_t now_ms, uint32_t now_us) {
+        int number = (event & 0x7F) - 1;
+        int row = number / 10, col = number % 10;
+        if (number < 0 || row >= Rows || col >= Cols)
+            return;
+
+        int key = row*Cols + col;
+        if (event & 0x80) {
+            _press_detect_us = now_us;
+            _press_edge_us = _edge_us;
+            _events.press(key, now_ms);
+        }
+        else
+            _events.release(key, now_ms);
+    }
+
+    int readRegister(char reg) {
+        char value;
+        if (readRegisters(reg, &value, 1) != 0)
+            return -1;
+        return value;
+    }
+
+    /** @return 0 on success, like I2C::read() */
+    int readRegisters(char reg, char *data, int length) {
+        if (_i2c.write(ADDRESS, &reg, 1, true) != 0)
+            return -1;
+        return _i2c.read(ADDRESS, data, length);
+    }
+
+    void writeRegister(char reg, char value) {
+        char data[2] = {reg, value};
+        _i2c.write(ADDRESS, data, 2);
+    }
+
+    Bus &_i2c;
+    Irq &_irq;
+    const char (*_key_map)[Cols];
+    KeyEvents _events;
+    Handler _wake;
+
+    volatile bool _pending;
+    volatile uint32_t _edge_us;
+    uint32_t _press_edge_us, _press_detect_us;
+    int _overflows;
+};
+
+#endif
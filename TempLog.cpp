@@ -0,0 +1,205 @@
+/**
+ * @file TempLog.cpp
+ *
+ * @brief Compressed, append-only temperature history
+ * kept in flash.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TempLog.h"
+#include <stdio.h>
+
+TempLog::TempLog(BlockDevice &device) :
+        _device(device), _block_size(0), _blocks(0), _open(false), _block(0),
+        _erased(-1), _sequence(0), _page_offset(0), _page_used(0), _pending_head(0),
+        _pending_count(0), _stats() {
+}
+
+int TempLog::init() {
+    int result = _device.init();
+    if (result != 0)
+        return result;
+
+    _block_size = _device.get_erase_size();
+    _blocks = _device.size() / _block_size;
+    _open = false;
+    _block = _blocks - 1;
+    _erased = -1;
+    _sequence = 0;
+
+    /** The newest block has the highest sequence number */
+    uint8_t page[TEMPLOG_PAGE_SIZE];
+    TempLogHeader header;
+    for (int i = 0; i < _blocks; i++) {
+        if (_device.read(page, i * _block_size, TEMPLOG_PAGE_SIZE) != 0)
+            continue;
+        if (tempLogHeader(page, header) && (!_open || header.sequence > _sequence)) {
+            _open = true;
+            _block = i;
+            _sequence = header.sequence;
+        }
+    }
+
+    if (!_open)
+        return 0;
+
+    /** Decode the newest block to find where it ends */
+    _device.read(page, _block * _block_size, TEMPLOG_PAGE_SIZE);
+    tempLogHeader(page, header);
+    tempLogStart(header, _state);
+
+    auto skip = [](uint32_t, int16_t) {};
+    _page_offset = TEMPLOG_PAGE_SIZE;
+    while (_page_offset + TEMPLOG_PAGE_SIZE <= _block_size) {
+        if (_device.read(page, _block * _block_size + _page_offset, TEMPLOG_PAGE_SIZE) != 0
+            || !tempLogDecodePage(page, skip, _state))
+            break;
+        _page_offset += TEMPLOG_PAGE_SIZE;
+    }
+    _page_used = 0;
+    return 0;
+}
+
+bool TempLog::append(uint32_t time, int16_t temp) {
+    if (_blocks == 0)
+        return false;
+
+    uint8_t record[TEMPLOG_MAX_RECORD];
+    TempLogState next = _state;
+    int length = tempLogEncode(record, next, time, temp);
+
+    if (_open && _page_used + length > TEMPLOG_PAGE_SIZE - 1 && !closePage()) {
+        _stats.dropped++;
+        return false;
+    }
+
+    /** No block yet, or no room for another page: the sample starts a new block */
+    if (!_open || (_page_used == 0 && _page_offset + TEMPLOG_PAGE_SIZE > _block_size)) {
+        if (!openBlock(time, temp)) {
+            _stats.dropped++;
+            return false;
+        }
+        return true;
+    }
+
+    memcpy(_page + 1 + _page_used, record, length);
+    _page_used += length;
+    _state = next;
+    _stats.samples++;
+    _stats.record_bytes += length;
+    return true;
+}
+
+void TempLog::service() {
+    if (_pending_count == 0)
+        return;
+
+    Pending &page = _pending[_pending_head];
+    if (page.erase) {
+        uint32_t block = page.address - page.address % _block_size;
+        _device.erase(block, _block_size);
+        _stats.erased_bytes += _block_size;
+    }
+    _device.program(page.data, page.address, TEMPLOG_PAGE_SIZE);
+    _stats.programmed_bytes += TEMPLOG_PAGE_SIZE;
+
+    _pending_head = (_pending_head + 1) % QUEUE_SIZE;
+    _pending_count--;
+}
+
+bool TempLog::eraseDue() const {
+    int next = (_block + 1) % _blocks;
+    return _open && _blocks > 1 && _erased != next && _page_offset > _block_size / 2;
+}
+
+void TempLog::eraseAhead() {
+    if (!eraseDue())
+        return;
+    int next = (_block + 1) % _blocks;
+    _device.erase(next * _block_size, _block_size);
+    _stats.erased_bytes += _block_size;
+    _erased = next;
+}
+
+void TempLog::flush() {
+    if (_open && _page_used > 0)
+        closePage();
+}
+
+const TempLogStats &TempLog::stats() const {
+    return _stats;
+}
+
+void TempLog::printStats() const {
+    uint32_t samples = _stats.samples ? _stats.samples : 1;
+    uint32_t records = _stats.record_bytes ? _stats.record_bytes : 1;
+
+    /** Ratios are printed with two decimals using integer math */
+    uint32_t per_sample = _stats.programmed_bytes * 100 / samples;
+    uint32_t amplification = _stats.programmed_bytes * 100 / records;
+    printf("log: samples=%lu bytes/sample=%lu.%02lu write amp=%lu.%02lu erased=%luKB dropped=%lu\n",
+           (unsigned long)_stats.samples,
+           (unsigned long)(per_sample / 100), (unsigned long)(per_sample % 100),
+           (unsigned long)(amplification / 100), (unsigned long)(amplification % 100),
+           (unsigned long)(_stats.erased_bytes / 1024),
+           (unsigned long)_stats.dropped);
+}
+
+/** Starts the next block of the ring with this sample in its header */
+bool TempLog::openBlock(uint32_t time, int16_t temp) {
+    Pending *page = queue();
+    if (!page)
+        return false;
+
+    _block = (_block + 1) % _blocks;
+    _sequence++;
+
+    TempLogHeader header;
+    header.magic = TEMPLOG_MAGIC;
+    header.sequence = _sequence;
+    header.time = time;
+    header.temp = temp;
+    header.check = tempLogCheck(header);
+
+    memset(page->data, 0xFF, TEMPLOG_PAGE_SIZE);
+    memcpy(page->data, &header, sizeof(header));
+    page->address = _block * _block_size;
+    page->erase = _erased != _block;
+    _erased = -1;
+
+    _open = true;
+    _page_offset = TEMPLOG_PAGE_SIZE;
+    _page_used = 0;
+    tempLogStart(header, _state);
+    _stats.samples++;
+    _stats.record_bytes += sizeof(header);
+    return true;
+}
+
+/** Moves the RAM page to the queue; the next page starts empty */
+bool TempLog::closePage() {
+    Pending *page = queue();
+    if (!page)
+        return false;
+
+    _page[0] = _page_used;
+    memset(_page + 1 + _page_used, 0xFF, TEMPLOG_PAGE_SIZE - 1 - _page_used);
+    memcpy(page->data, _page, TEMPLOG_PAGE_SIZE);
+    page->address = _block * _block_size + _page_offset;
+    page->erase = false;
+
+    _page_offset += TEMPLOG_PAGE_SIZE;
+    _page_used = 0;
+    return true;
+}
+
+/** @return the next free queue entry, or NULL if the queue is full */
+TempLog::Pending *TempLog::queue() {
+    if (_pending_count == QUEUE_SIZE)
+        return NULL;
+    Pending *page = &_pending[(_pending_head + _pending_count) % QUEUE_SIZE];
+    _pending_count++;
+    return page;
+}
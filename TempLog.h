@@ -0,0 +1,167 @@
+/**
+ * @file TempLog.h
+ *
+ * @brief Compressed, append-only temperature history
+ * kept in flash.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TEMPLOG_H
+#define TEMPLOG_H
+
+#include "BlockDevice.h"
+#include "TempLogFormat.h"
+#include <stdint.h>
+
+/** Counters for judging how well the log packs into flash */
+struct TempLogStats {
+    uint32_t samples;           /**< samples appended */
+    uint32_t record_bytes;      /**< encoded bytes, headers included */
+    uint32_t programmed_bytes;  /**< bytes programmed into flash */
+    uint32_t erased_bytes;      /**< bytes erased */
+    uint32_t dropped;           /**< samples lost to a full page queue */
+};
+
+/**
+ * @brief Append-only log of (timestamp, temperature) samples in
+ * flash, in the format described in TempLogFormat.h.
+ *
+ * The erase blocks of the block device are used as a ring, so
+ * every block is erased once per trip around the ring and wear
+ * is spread evenly. The oldest block is erased only when the
+ * log needs it again.
+ *
+ * append() only encodes into a RAM page and never touches flash.
+ * Full pages wait in a short queue until service() programs them,
+ * one page per call, which takes well under a millisecond.
+ *
+ * Erasing is kept apart: once the open block is half full,
+ * eraseDue() turns true and eraseAhead() erases the next block of
+ * the ring, long before a sample needs it. On internal flash the
+ * sector erase stalls the CPU for a second or more whatever thread
+ * runs it, so the application gives it an event of its own. Only
+ * if that has not happened does service() erase the block as it
+ * opens. Erasing ahead drops the oldest block half a block early.
+ *
+ * Samples still in the RAM page are lost on reset; flush() writes
+ * the page out early at the cost of its unused bytes.
+ *
+ * Only the BlockDevice interface is used, so the log can be run on
+ * a host against a RAM block device.
+ */
+class TempLog {
+public:
+
+    /** @param device Flash to keep the log in; every erase block is used */
+    TempLog(BlockDevice &device);
+
+    /**
+     * @brief Finds the newest block and resumes after its last sample.
+     *
+     * @return 0 on success, or the block device error.
+     */
+    int init();
+
+    /**
+     * @brief Adds a sample.
+     *
+     * @param time Timestamp in seconds
+     * @param temp Temperature in tenths of a degree C
+     * @return false if the sample was dropped because too many
+     *         pages are waiting for service().
+     */
+    bool append(uint32_t time, int16_t temp);
+
+    /** Programs one waiting page, erasing its block first if it was not erased ahead */
+    void service();
+
+    /** @return true if the next block of the ring should be erased now */
+    bool eraseDue() const;
+
+    /** Erases the next block of the ring ahead of its use */
+    void eraseAhead();
+
+    /** Queues the partly filled page so its samples reach flash */
+    void flush();
+
+    /**
+     * @brief Reads every sample in flash, oldest first.
+     *
+     * Samples that have not been programmed yet are not included.
+     *
+     * @param visit Called with the timestamp and temperature of each sample
+     */
+    template<typename Visitor>
+    void forEach(Visitor visit);
+
+    /** @return the packing counters */
+    const TempLogStats &stats() const;
+
+    /** Prints bytes per sample and write amplification over the serial port */
+    void printStats() const;
+
+private:
+    /** A page waiting to be programmed */
+    struct Pending {
+        uint32_t address;
+        bool erase;
+        uint8_t data[TEMPLOG_PAGE_SIZE];
+    };
+
+    static const int QUEUE_SIZE = 3;
+
+    bool openBlock(uint32_t time, int16_t temp);
+    bool closePage();
+    Pending *queue();
+
+    BlockDevice &_device;
+    uint32_t _block_size;
+    int _blocks;
+
+    bool _open;
+    int _block;
+    int _erased;            /**< block erased ahead, -1 if none */
+    uint32_t _sequence;
+    uint32_t _page_offset;
+
+    uint8_t _page[TEMPLOG_PAGE_SIZE];
+    int _page_used;
+    TempLogState _state;
+
+    Pending _pending[QUEUE_SIZE];
+    int _pending_head, _pending_count;
+
+    TempLogStats _stats;
+};
+
+template<typename Visitor>
+void TempLog::forEach(Visitor visit) {
+    if (!_open)
+        return;
+
+    uint8_t page[TEMPLOG_PAGE_SIZE];
+
+    /** Blocks are opened in ring order, so the oldest follows the newest */
+    for (int n = 1; n <= _blocks; n++) {
+        int block = (_block + n) % _blocks;
+        uint32_t base = block * _block_size;
+        TempLogHeader header;
+        TempLogState state;
+
+        if (_device.read(page, base, TEMPLOG_PAGE_SIZE) != 0 || !tempLogHeader(page, header))
+            continue;
+        tempLogStart(header, state);
+        visit(state.time, int16_t(state.temp));
+
+        for (uint32_t offset = TEMPLOG_PAGE_SIZE; offset + TEMPLOG_PAGE_SIZE <= _block_size;
+             offset += TEMPLOG_PAGE_SIZE) {
+            if (_device.read(page, base + offset, TEMPLOG_PAGE_SIZE) != 0
+                || !tempLogDecodePage(page, visit, state))
+                break;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,234 @@
+/**
+ * @file TempLogFormat.h
+ *
+ * @brief On-flash format of the temperature history log.
+ *
+ * This header has no mbed dependencies so the same code
+ * decodes the log on the device and on a host computer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TEMPLOGFORMAT_H
+#define TEMPLOGFORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Layout of one erase block of the log:
+ *
+ *   page 0      block header (TempLogHeader), holds the first sample
+ *   page 1..n   data pages: one count byte, then that many bytes
+ *               of records; an erased page has a count of 0xFF
+ *
+ * Each block decodes on its own. Blocks are used as a ring and the
+ * header's sequence number tells the newest one apart.
+ *
+ * A record stores the second difference of the timestamp and the
+ * difference of the temperature, both zig-zag coded so small
+ * negative values stay small:
+ *
+ *   0xxxxxxx              timestamp step unchanged, temperature
+ *                         delta zig-zag coded in 7 bits
+ *   10000000 <dod> <dt>   varint timestamp delta-of-delta, then
+ *                         varint temperature delta
+ *
+ * At a steady sample rate almost every record is one byte.
+ */
+
+/** Bytes per page; one page is the unit of programming */
+const int TEMPLOG_PAGE_SIZE = 32;
+
+/** Marks a block header ("TLOG") */
+const uint32_t TEMPLOG_MAGIC = 0x474F4C54;
+
+/** Count byte of a page that has not been written */
+const uint8_t TEMPLOG_ERASED = 0xFF;
+
+/** Longest encoded record, in bytes */
+const int TEMPLOG_MAX_RECORD = 1 + 5 + 5;
+
+/** Header at the start of every block */
+struct TempLogHeader {
+    uint32_t magic;
+    uint32_t sequence;  /**< increases by one for every block opened */
+    uint32_t time;      /**< timestamp of the first sample, seconds */
+    int16_t temp;       /**< first sample, tenths of a degree C */
+    uint16_t check;     /**< low half of sequence ^ time ^ ~magic */
+};
+
+/** @return the check value of a header */
+inline uint16_t tempLogCheck(const TempLogHeader &header) {
+    return (header.sequence ^ header.time ^ ~header.magic) & 0xFFFF;
+}
+
+/** Decoder/encoder state carried from record to record */
+struct TempLogState {
+    uint32_t time;  /**< timestamp of the last sample */
+    int32_t step;   /**< time between the last two samples */
+    int32_t temp;   /**< last sample */
+};
+
+inline uint32_t zigzag(int32_t value) {
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value) {
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+/** @return number of bytes written */
+inline int putVarint(uint8_t *out, uint32_t value) {
+    int n = 0;
+    while (value >= 0x80) {
+        out[n++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = uint8_t(value);
+    return n;
+}
+
+/** @return number of bytes read, 0 if the data ran out */
+inline int getVarint(const uint8_t *in, int length, uint32_t &value) {
+    value = 0;
+    for (int n = 0; n < length && n < 5; n++) {
+        value |= uint32_t(in[n] & 0x7F) << (7*n);
+        if (!(in[n] & 0x80))
+            return n + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Encodes one sample after the one held in state.
+ *
+ * @param out At least TEMPLOG_MAX_RECORD bytes
+ * @return number of bytes written
+ */
+inline int tempLogEncode(uint8_t *out, TempLogState &state, uint32_t time, int16_t temp) {
+    int32_t step = int32_t(time - state.time);
+    int32_t dod = step - state.step;
+    uint32_t dt = zigzag(temp - state.temp);
+    int n;
+
+    if (dod == 0 && dt < 0x80) {
+        out[0] = dt;
+        n = 1;
+    }
+    else {
+        out[0] = 0x80;
+        n = 1 + putVarint(out + 1, zigzag(dod));
+        n += putVarint(out + n, dt);
+    }
+
+    state.time = time;
+    state.step = step;
+    state.temp = temp;
+    return n;
+}
+
+/**
+ * @brief Decodes the sample after the one held in state.
+ *
+ * @return number of bytes read, 0 if the record is cut short
+ */
+inline int tempLogDecode(const uint8_t *in, int length, TempLogState &state) {
+    if (length < 1)
+        return 0;
+
+    int32_t dod = 0;
+    uint32_t dt;
+    int n;
+
+    if (!(in[0] & 0x80)) {
+        dt = in[0];
+        n = 1;
+    }
+    else {
+        uint32_t value;
+        int a = getVarint(in + 1, length - 1, value);
+        if (a == 0)
+            return 0;
+        dod = unzigzag(value);
+        int b = getVarint(in + 1 + a, length - 1 - a, dt);
+        if (b == 0)
+            return 0;
+        n = 1 + a + b;
+    }
+
+    state.step += dod;
+    state.time += state.step;
+    state.temp += unzigzag(dt);
+    return n;
+}
+
+/**
+ * @brief Reads the header of a block.
+ *
+ * @return true if the block holds a valid header.
+ */
+inline bool tempLogHeader(const uint8_t *block, TempLogHeader &header) {
+    memcpy(&header, block, sizeof(header));
+    return header.magic == TEMPLOG_MAGIC && header.check == tempLogCheck(header);
+}
+
+/**
+ * @brief Decodes every sample of one data page.
+ *
+ * @param page  TEMPLOG_PAGE_SIZE bytes
+ * @param visit Called as visit(time, temp) for each sample
+ * @param state Carried over from the previous page
+ * @return false if the page has not been written
+ */
+template<typename Visitor>
+bool tempLogDecodePage(const uint8_t *page, Visitor &visit, TempLogState &state) {
+    int count = page[0];
+    if (count == TEMPLOG_ERASED || count > TEMPLOG_PAGE_SIZE - 1)
+        return false;
+
+    int pos = 0;
+    while (pos < count) {
+        int n = tempLogDecode(page + 1 + pos, count - pos, state);
+        if (n == 0)
+            break;
+        pos += n;
+        visit(state.time, int16_t(state.temp));
+    }
+    return true;
+}
+
+/** Starts the decoder state at the sample held in a block header */
+inline void tempLogStart(const TempLogHeader &header, TempLogState &state) {
+    state.time = header.time;
+    state.step = 0;
+    state.temp = header.temp;
+}
+
+/**
+ * @brief Decodes every sample of one block held in memory.
+ *
+ * @param block     Block contents
+ * @param size      Block size in bytes
+ * @param visit     Called as visit(time, temp) for each sample
+ * @param state     Left at the last sample of the block
+ * @return offset of the first unwritten page, or 0 if the block
+ *         has no valid header
+ */
+template<typename Visitor>
+uint32_t tempLogDecodeBlock(const uint8_t *block, uint32_t size, Visitor visit, TempLogState &state) {
+    TempLogHeader header;
+    if (!tempLogHeader(block, header))
+        return 0;
+
+    tempLogStart(header, state);
+    visit(state.time, int16_t(state.temp));
+
+    uint32_t offset = TEMPLOG_PAGE_SIZE;
+    while (offset + TEMPLOG_PAGE_SIZE <= size && tempLogDecodePage(block + offset, visit, state))
+        offset += TEMPLOG_PAGE_SIZE;
+    return offset;
+}
+
+#endif
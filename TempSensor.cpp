@@ -0,0 +1,84 @@
+/**
+ * @file TempSensor.cpp
+ *
+ * @brief Temperature sensor drivers with split, non-blocking
+ * conversions, and a scheduler that polls several of them.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TempSensor.h"
+
+TempSensorScheduler::TempSensorScheduler(int period_ms) :
+        _count(0), _next(0), _period_ms(period_ms) {}
+
+bool TempSensorScheduler::add(TempSensor &sensor) {
+    if (_count == MAX_SENSORS)
+        return false;
+
+    Slot &slot = _slots[_count++];
+    slot.sensor = &sensor;
+    slot.converting = false;
+    slot.started = false;
+    slot.start_ms = slot.due_ms = 0;
+    slot.sample.tenths_c = 0;
+    slot.sample.count = 0;
+    slot.errors = 0;
+    return true;
+}
+
+void TempSensorScheduler::update(uint32_t now_ms) {
+    if (_count == 0)
+        return;
+
+    Slot &slot = _slots[_next];
+    _next = _next + 1 == _count ? 0 : _next + 1;
+
+    if (slot.converting) {
+        if (slot.sensor->poll()) {
+            int16_t tenths_c;
+            if (slot.sensor->read(tenths_c)) {
+                slot.sample.tenths_c = tenths_c;
+                slot.sample.count++;
+            }
+            else
+                slot.errors++;
+            slot.converting = false;
+        }
+        else if (now_ms - slot.start_ms > uint32_t(2*slot.sensor->conversionMs())) {
+            slot.errors++;
+            slot.converting = false;
+        }
+        else
+            return;
+    }
+
+    /** A sensor that just finished starts again in the same turn if it is already due */
+    if (slot.started && int32_t(now_ms - slot.due_ms) < 0)
+        return;
+
+    /** Keep the readings on the period's grid unless we fell a whole period behind */
+    slot.due_ms = slot.started && int32_t(now_ms - slot.due_ms) < _period_ms ?
+                  slot.due_ms + _period_ms : now_ms + _period_ms;
+    slot.started = true;
+
+    if (slot.sensor->start()) {
+        slot.converting = true;
+        slot.start_ms = now_ms;
+    }
+    else
+        slot.errors++;
+}
+
+int TempSensorScheduler::count() const {
+    return _count;
+}
+
+TempSample TempSensorScheduler::reading(int index) const {
+    return _slots[index].sample;
+}
+
+uint32_t TempSensorScheduler::errors(int index) const {
+    return _slots[index].errors;
+}
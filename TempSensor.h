@@ -0,0 +1,276 @@
+/**
+ * @file TempSensor.h
+ *
+ * @brief Temperature sensor drivers with split, non-blocking
+ * conversions, and a scheduler that polls several of them.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TEMPSENSOR_H
+#define TEMPSENSOR_H
+
+#include "OneWireCrc.h"
+#include <stdint.h>
+
+/**
+ * @brief A temperature sensor whose conversion is split into
+ * start, poll and read, so a slow conversion never blocks.
+ *
+ * The bus drivers are templates on the bus type and this header
+ * has no mbed dependencies, so a host build can run them against
+ * a mock bus with the same member functions. The analog sensor,
+ * which needs the ADC, is in AnalogTempSensor.h.
+ */
+class TempSensor {
+public:
+    virtual ~TempSensor() {}
+
+    /**
+     * @brief Starts a conversion.
+     *
+     * @return false if the sensor did not respond.
+     */
+    virtual bool start() = 0;
+
+    /** @return true once the conversion has finished */
+    virtual bool poll() = 0;
+
+    /**
+     * @brief Reads the result of the finished conversion.
+     *
+     * @param tenths_c Set to the temperature in tenths of a degree C
+     * @return false if the result could not be read or was corrupt.
+     */
+    virtual bool read(int16_t &tenths_c) = 0;
+
+    /** @return longest time a conversion takes, in milliseconds */
+    virtual int conversionMs() const = 0;
+};
+
+/** @return a raw reading in 1/16 degree C in tenths of a degree, rounded */
+inline int16_t sixteenthsToTenths(int32_t sixteenths) {
+    int32_t scaled = sixteenths * 10;
+    return (scaled + (scaled < 0 ? -8 : 8)) / 16;
+}
+
+/**
+ * @brief Maxim DS18B20 on a 1-Wire bus, at 12-bit resolution.
+ *
+ * A conversion takes up to 750 ms. While it runs the sensor
+ * answers read slots with 0, so poll() costs one read slot. The
+ * sensor must be powered from VDD; in parasite power mode it
+ * cannot answer read slots while converting.
+ *
+ * @tparam Bus 1-Wire master with reset(), writeByte(), readByte()
+ *             and readBit(), such as OneWire
+ */
+template<typename Bus>
+class DS18B20Sensor : public TempSensor {
+public:
+
+    /**
+     * @param bus 1-Wire bus of the sensor
+     * @param rom 64-bit ROM code of the sensor, or 0 (default) if
+     *            it is the only device on the bus
+     */
+    DS18B20Sensor(Bus &bus, const uint8_t *rom = 0) : _bus(bus), _rom(rom) {}
+
+    virtual bool start() {
+        if (!select())
+            return false;
+        _bus.writeByte(CONVERT_T);
+        return true;
+    }
+
+    virtual bool poll() {
+        return _bus.readBit() != 0;
+    }
+
+    virtual bool read(int16_t &tenths_c) {
+        if (!select())
+            return false;
+        _bus.writeByte(READ_SCRATCHPAD);
+
+        uint8_t scratchpad[9];
+        for (int i = 0; i < 9; i++)
+            scratchpad[i] = _bus.readByte();
+
+        /** A missing sensor reads as all ones, which passes neither check */
+        if (scratchpad[4] == 0xFF || oneWireCrc8(scratchpad, 9) != 0)
+            return false;
+
+        tenths_c = sixteenthsToTenths(int16_t(scratchpad[1] << 8 | scratchpad[0]));
+        return true;
+    }
+
+    virtual int conversionMs() const {
+        return 750;
+    }
+
+private:
+    enum {
+        MATCH_ROM = 0x55,
+        SKIP_ROM = 0xCC,
+        CONVERT_T = 0x44,
+        READ_SCRATCHPAD = 0xBE,
+    };
+
+    /** Resets the bus and addresses this sensor */
+    bool select() {
+        if (!_bus.reset())
+            return false;
+        if (_rom) {
+            _bus.writeByte(MATCH_ROM);
+            for (int i = 0; i < 8; i++)
+                _bus.writeByte(_rom[i]);
+        }
+        else
+            _bus.writeByte(SKIP_ROM);
+        return true;
+    }
+
+    Bus &_bus;
+    const uint8_t *_rom;
+};
+
+/**
+ * @brief TI TMP102 / TMP112 on an I2C bus.
+ *
+ * The sensor is kept in shutdown and each start() asks for one
+ * one-shot conversion (about 30 ms), so it draws almost nothing
+ * between readings. The OS bit of the configuration register
+ * reads 1 again once the conversion is done.
+ *
+ * @tparam Bus mbed's I2C, or anything with the same read() and
+ *             write()
+ */
+template<typename Bus>
+class TMP1xxSensor : public TempSensor {
+public:
+
+    /**
+     * @param i2c     I2C bus of the sensor
+     * @param address 8-bit I2C address (0x48 << 1 with ADD0 to ground)
+     */
+    TMP1xxSensor(Bus &i2c, int address = 0x48 << 1) : _i2c(i2c), _address(address) {}
+
+    virtual bool start() {
+        char data[3] = {CONFIG, char(CONFIG_OS | CONFIG_SD | CONFIG_12BIT), char(CONFIG_LOW)};
+        return _i2c.write(_address, data, 3) == 0;
+    }
+
+    virtual bool poll() {
+        char config[2];
+        if (readRegister(CONFIG, config) != 0)
+            return false;
+        return config[0] & CONFIG_OS;
+    }
+
+    virtual bool read(int16_t &tenths_c) {
+        char data[2];
+        if (readRegister(TEMPERATURE, data) != 0)
+            return false;
+
+        /** 12-bit two's complement, left aligned, 1/16 degree per count */
+        int16_t raw = int16_t(uint8_t(data[0]) << 8 | uint8_t(data[1]));
+        tenths_c = sixteenthsToTenths(raw >> 4);
+        return true;
+    }
+
+    virtual int conversionMs() const {
+        return 35;
+    }
+
+private:
+    enum {
+        TEMPERATURE = 0x00,
+        CONFIG = 0x01,
+    };
+
+    enum {
+        CONFIG_OS = 0x80,
+        CONFIG_12BIT = 0x60,
+        CONFIG_SD = 0x01,
+        CONFIG_LOW = 0xA0,
+    };
+
+    /** @return 0 on success, like I2C::read() */
+    int readRegister(char reg, char *data) {
+        if (_i2c.write(_address, &reg, 1, true) != 0)
+            return -1;
+        return _i2c.read(_address, data, 2);
+    }
+
+    Bus &_i2c;
+    int _address;
+};
+
+/** Latest reading of one scheduled sensor */
+struct TempSample {
+    int16_t tenths_c;   /**< temperature in tenths of a degree C */
+    uint32_t count;     /**< readings taken so far, 0 before the first */
+};
+
+/**
+ * @brief Polls up to MAX_SENSORS sensors without blocking.
+ *
+ * Each update() advances one sensor, in turn: it polls a running
+ * conversion and reads the result once it is done, then starts the
+ * next conversion when the sensor is due. All conversions run at the
+ * same time, so a set of sensors costs about one conversion
+ * period rather than the sum of them. A conversion that is not
+ * done after twice its conversion time counts as an error.
+ */
+class TempSensorScheduler {
+public:
+
+    static const int MAX_SENSORS = 4;
+
+    /**
+     * @param period_ms Time between readings of each sensor
+     */
+    TempSensorScheduler(int period_ms = 1000);
+
+    /**
+     * @brief Adds a sensor; its first conversion starts on the
+     * next update().
+     *
+     * @return false if MAX_SENSORS are already added.
+     */
+    bool add(TempSensor &sensor);
+
+    /**
+     * @brief Advances the next sensor in turn.
+     *
+     * @param now_ms Milliseconds from a free-running clock.
+     */
+    void update(uint32_t now_ms);
+
+    /** @return number of sensors */
+    int count() const;
+
+    /** @return the latest reading of a sensor */
+    TempSample reading(int index) const;
+
+    /** @return failed starts, reads and timed out conversions of a sensor */
+    uint32_t errors(int index) const;
+
+private:
+    struct Slot {
+        TempSensor *sensor;
+        bool converting;
+        bool started;       /**< due_ms is valid */
+        uint32_t start_ms;
+        uint32_t due_ms;
+        TempSample sample;
+        uint32_t errors;
+    };
+
+    Slot _slots[MAX_SENSORS];
+    int _count, _next;
+    int _period_ms;
+};
+
+#endif
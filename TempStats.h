@@ -0,0 +1,461 @@
+/**
+ * @file TempStats.h
+ *
+ * @brief Statistics over the temperature history.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TEMPSTATS_H
+#define TEMPSTATS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Minimum, maximum and mean over the last Window samples,
+ * in amortized O(1) time per sample.
+ *
+ * The samples are kept in a ring. The minimum and maximum each
+ * come from a monotonic deque of ring positions: a new sample
+ * drops every queued sample it beats from the back, so the front
+ * is always the extreme of the window, and the front leaves when
+ * its sample is overwritten. Each sample enters and leaves each
+ * deque once. The mean comes from a running sum.
+ *
+ * RAM is fixed at 6 bytes per sample plus a few counters:
+ * 24 hours at one sample a minute (Window = 1440) takes 8.5 KB.
+ *
+ * @tparam Window Number of samples in the window (up to 65535)
+ */
+template<int Window>
+class RollingStats {
+public:
+
+    static_assert(Window > 0 && Window <= 65535, "window must fit 16-bit positions");
+
+    RollingStats() : _next(0), _count(0), _sum(0),
+            _min_head(0), _min_count(0), _max_head(0), _max_count(0) {}
+
+    /** Adds a sample, dropping the oldest one once the window is full */
+    void add(int16_t value) {
+        int pos = _next;
+
+        if (_count == Window) {
+            /** The oldest sample lives where the new one goes */
+            _sum -= _samples[pos];
+            if (_min_count && _min_queue[_min_head] == pos)
+                popFront(_min_head, _min_count);
+            if (_max_count && _max_queue[_max_head] == pos)
+                popFront(_max_head, _max_count);
+        }
+        else
+            _count++;
+
+        _samples[pos] = value;
+        _sum += value;
+
+        while (_min_count && _samples[back(_min_queue, _min_head, _min_count)] >= value)
+            _min_count--;
+        pushBack(_min_queue, _min_head, _min_count, pos);
+
+        while (_max_count && _samples[back(_max_queue, _max_head, _max_count)] <= value)
+            _max_count--;
+        pushBack(_max_queue, _max_head, _max_count, pos);
+
+        _next = pos + 1 == Window ? 0 : pos + 1;
+    }
+
+    /** @return number of samples in the window */
+    int count() const {
+        return _count;
+    }
+
+    /** @return smallest sample in the window, 0 if empty */
+    int16_t min() const {
+        return _min_count ? _samples[_min_queue[_min_head]] : 0;
+    }
+
+    /** @return largest sample in the window, 0 if empty */
+    int16_t max() const {
+        return _max_count ? _samples[_max_queue[_max_head]] : 0;
+    }
+
+    /** @return mean of the window, rounded toward zero, 0 if empty */
+    int16_t mean() const {
+        return _count ? _sum / _count : 0;
+    }
+
+private:
+    static int back(const uint16_t *queue, int head, int count) {
+        int i = head + count - 1;
+        return queue[i >= Window ? i - Window : i];
+    }
+
+    static void pushBack(uint16_t *queue, int head, int &count, int pos) {
+        int i = head + count;
+        queue[i >= Window ? i - Window : i] = pos;
+        count++;
+    }
+
+    static void popFront(int &head, int &count) {
+        head = head + 1 == Window ? 0 : head + 1;
+        count--;
+    }
+
+    int16_t _samples[Window];
+    uint16_t _min_queue[Window];
+    uint16_t _max_queue[Window];
+
+    int _next, _count;
+    int32_t _sum;
+    int _min_head, _min_count;
+    int _max_head, _max_count;
+};
+
+/**
+ * @brief Least-squares slope of the last Window samples, updated
+ * in O(1) per sample.
+ *
+ * Samples are taken as evenly spaced, at x = 0 for the oldest up
+ * to x = n - 1 for the newest. Only the sums of y and x*y change as
+ * samples arrive; when the oldest sample leaves, every x drops by
+ * one, which takes the sum of the remaining y off the x*y sum. The
+ * sums of x and x*x depend on n alone. All sums are integers, so
+ * they never drift.
+ *
+ * @tparam Window Number of samples in the window
+ */
+template<int Window>
+class TrendEstimator {
+public:
+
+    static_assert(Window >= 2, "a slope needs two samples");
+
+    TrendEstimator() : _next(0), _count(0), _sum_y(0), _sum_xy(0) {}
+
+    /** Adds a sample, dropping the oldest one once the window is full */
+    void add(int16_t value) {
+        if (_count == Window) {
+            int16_t oldest = _samples[_next];
+            _sum_xy += int64_t(Window - 1) * value - (_sum_y - oldest);
+            _sum_y += value - oldest;
+        }
+        else {
+            _sum_xy += int64_t(_count) * value;
+            _sum_y += value;
+            _count++;
+        }
+
+        _samples[_next] = value;
+        _next = _next + 1 == Window ? 0 : _next + 1;
+    }
+
+    /** @return number of samples in the window */
+    int count() const {
+        return _count;
+    }
+
+    /**
+     * @brief Slope of the window.
+     *
+     * @param scale Samples per unit of the result, e.g. 3600 for
+     *              the change per hour of one sample a second
+     * @return change of the sample value per scale samples, rounded
+     *         toward zero, 0 with fewer than two samples
+     */
+    int32_t slope(int32_t scale) const {
+        if (_count < 2)
+            return 0;
+
+        int64_t n = _count;
+        int64_t sum_x = n * (n - 1) / 2;
+        int64_t sum_xx = (n - 1) * n * (2*n - 1) / 6;
+        int64_t num = n * _sum_xy - sum_x * _sum_y;
+        int64_t den = n * sum_xx - sum_x * sum_x;
+        return num * scale / den;
+    }
+
+private:
+    int16_t _samples[Window];
+    int _next, _count;
+    int32_t _sum_y;
+    int64_t _sum_xy;
+};
+
+/**
+ * @brief Minimum, maximum, sum and count of the samples that fell
+ * into one time bucket. Two rollups merge into the rollup of
+ * both sets of samples.
+ */
+struct Rollup {
+    int16_t min, max;
+    int32_t sum;
+    uint32_t count;
+
+    Rollup() : min(0), max(0), sum(0), count(0) {}
+
+    /** Adds one sample */
+    void add(int16_t value) {
+        if (!count || value < min)
+            min = value;
+        if (!count || value > max)
+            max = value;
+        sum += value;
+        count++;
+    }
+
+    /** Adds every sample of another rollup */
+    void merge(const Rollup &other) {
+        if (!other.count)
+            return;
+        if (!count || other.min < min)
+            min = other.min;
+        if (!count || other.max > max)
+            max = other.max;
+        sum += other.sum;
+        count += other.count;
+    }
+
+    /** @return mean, rounded toward zero, 0 if empty */
+    int16_t mean() const {
+        return count ? sum / int32_t(count) : 0;
+    }
+};
+
+/**
+ * @brief Ring of the last Buckets rollups of one resolution,
+ * each covering Period seconds aligned to the epoch.
+ *
+ * @tparam Buckets Number of buckets kept
+ * @tparam Period  Seconds per bucket
+ */
+template<int Buckets, uint32_t Period>
+class RollupLevel {
+public:
+
+    RollupLevel() : _newest(0), _head(0), _used(0) {}
+
+    /**
+     * @brief Merges a rollup into the bucket holding time. A time
+     * past the newest bucket closes it and starts a new one; a
+     * time before it (clock set back) goes into the newest bucket.
+     *
+     * @param closed      Set to the bucket that was closed
+     * @param closed_time Set to the start of the closed bucket
+     * @return true if a bucket was closed
+     */
+    bool add(uint32_t time, const Rollup &rollup, Rollup &closed, uint32_t &closed_time) {
+        uint32_t number = time / Period;
+        bool did_close = false;
+
+        if (!_used) {
+            _newest = number;
+            _used = 1;
+        }
+        else if (number > _newest) {
+            closed = _buckets[_head];
+            closed_time = _newest * Period;
+            did_close = true;
+            advance(number);
+        }
+
+        _buckets[_head].merge(rollup);
+        return did_close;
+    }
+
+    /** @return rollup of the buckets starting in [from, to) */
+    Rollup range(uint32_t from, uint32_t to) const {
+        Rollup result;
+        int i = _head;
+        for (int age = 0; age < _used; age++) {
+            uint32_t start = (_newest - age) * Period;
+            if (start < from)
+                break;
+            if (start < to)
+                result.merge(_buckets[i]);
+            i = i == 0 ? Buckets - 1 : i - 1;
+        }
+        return result;
+    }
+
+    /** @return the newest bucket, still collecting samples */
+    const Rollup &current() const {
+        return _buckets[_head];
+    }
+
+    /** @return start time of the newest bucket */
+    uint32_t currentTime() const {
+        return _newest * Period;
+    }
+
+    /** @return true once a sample has arrived */
+    bool started() const {
+        return _used != 0;
+    }
+
+private:
+    /** Moves the head forward to bucket number, emptying the buckets it passes */
+    void advance(uint32_t number) {
+        uint32_t steps = number - _newest;
+        if (steps > Buckets)
+            steps = Buckets;
+        for (uint32_t n = 0; n < steps; n++) {
+            _head = _head + 1 == Buckets ? 0 : _head + 1;
+            _buckets[_head] = Rollup();
+        }
+        _used = _used + steps > Buckets ? Buckets : _used + steps;
+        _newest = number;
+    }
+
+    Rollup _buckets[Buckets];
+    uint32_t _newest;
+    int _head, _used;
+};
+
+/** Resolutions kept by TempHistory */
+enum Resolution {MINUTES, HOURS, DAYS};
+
+/**
+ * @brief Temperature history as a pyramid of per minute, per hour
+ * and per day rollups, updated in O(1) per sample.
+ *
+ * Samples go into the open minute bucket. When a minute closes its
+ * rollup is merged into the open hour, and a closing hour is merged
+ * into the open day, so no level ever scans the one below it. A
+ * range query at any resolution merges the precomputed buckets of
+ * that level plus the open buckets of the finer levels that have
+ * not been passed up yet.
+ *
+ * At 12 bytes per bucket the default of an hour of minutes, a week
+ * of hours and a month of days takes about 3 KB.
+ *
+ * @tparam Minutes Minute buckets kept
+ * @tparam Hours   Hour buckets kept
+ * @tparam Days    Day buckets kept
+ */
+template<int Minutes = 60, int Hours = 24*7, int Days = 31>
+class TempHistory {
+public:
+
+    /**
+     * @brief Adds a sample.
+     *
+     * @param time  Seconds since the epoch
+     * @param value Temperature in tenths of a degree C
+     */
+    void add(uint32_t time, int16_t value) {
+        Rollup sample, minute, hour, day;
+        uint32_t minute_time, hour_time, day_time;
+        sample.add(value);
+
+        if (_minutes.add(time, sample, minute, minute_time)
+                && _hours.add(minute_time, minute, hour, hour_time))
+            _days.add(hour_time, hour, day, day_time);
+    }
+
+    /**
+     * @brief Rollup of every sample in the buckets of the given
+     * resolution that start in [from, to).
+     *
+     * @param resolution Bucket size the range is aligned to
+     * @param from       Start time, seconds since the epoch
+     * @param to         End time (exclusive)
+     */
+    Rollup range(Resolution resolution, uint32_t from, uint32_t to) const {
+        if (resolution == MINUTES)
+            return _minutes.range(from, to);
+
+        uint32_t period = resolution == HOURS ? 3600 : 86400;
+        Rollup result = resolution == HOURS ? _hours.range(from, to) : _days.range(from, to);
+
+        /** Open finer buckets belong to the bucket containing their start */
+        if (resolution == DAYS && _hours.started() && inRange(_hours.currentTime(), period, from, to))
+            result.merge(_hours.current());
+        if (_minutes.started() && inRange(_minutes.currentTime(), period, from, to))
+            result.merge(_minutes.current());
+        return result;
+    }
+
+private:
+    static bool inRange(uint32_t time, uint32_t period, uint32_t from, uint32_t to) {
+        uint32_t start = time - time % period;
+        return start >= from && start < to;
+    }
+
+    RollupLevel<Minutes, 60> _minutes;
+    RollupLevel<Hours, 3600> _hours;
+    RollupLevel<Days, 86400> _days;
+};
+
+/**
+ * @return tenths of a degree rounded to whole degrees, halves away
+ * from zero. Every temperature the display shows goes through this,
+ * so the current reading and the low/high/mean always agree.
+ */
+inline int roundTenths(int tenths) {
+    return (tenths + (tenths < 0 ? -5 : 5)) / 10;
+}
+
+/**
+ * @brief Turns a temperature in tenths of a degree into the whole
+ * degrees to show, changing only on meaningful moves.
+ *
+ * The shown value changes only when the reading leaves the
+ * rounding range of the shown value by more than the band, and
+ * no sooner than the hold time after the last change. A reading
+ * that hovers around a rounding edge therefore stays put instead
+ * of flipping the digit every second.
+ */
+class Hysteresis {
+public:
+
+    /**
+     * @param band    Tenths of a degree past the rounding edge
+     *                before the shown value moves
+     * @param hold_ms Least time between two changes
+     */
+    Hysteresis(int band = 3, uint32_t hold_ms = 10000) :
+            _band(band), _hold_ms(hold_ms), _valid(false), _shown(0), _changed_ms(0) {}
+
+    /**
+     * @brief Feeds a reading.
+     *
+     * @param tenths Reading in tenths of a degree
+     * @param now_ms Milliseconds from a free-running clock
+     * @return true if the shown value changed
+     */
+    bool update(int tenths, uint32_t now_ms) {
+        if (_valid) {
+            int away = tenths - _shown*10;
+            if (now_ms - _changed_ms < _hold_ms || (away < 5 + _band && away > -5 - _band))
+                return false;
+        }
+
+        int shown = roundTenths(tenths);
+        bool changed = !_valid || shown != _shown;
+        _shown = shown;
+        _changed_ms = now_ms;
+        _valid = true;
+        return changed;
+    }
+
+    /** @return the value to show, in whole degrees */
+    int shown() const {
+        return _shown;
+    }
+
+    /** Forgets the shown value, e.g. when the unit changes */
+    void reset() {
+        _valid = false;
+    }
+
+private:
+    int _band;
+    uint32_t _hold_ms;
+    bool _valid;
+    int _shown;
+    uint32_t _changed_ms;
+};
+
+#endif
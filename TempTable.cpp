@@ -0,0 +1,127 @@
+/**
+ * @file TempTable.cpp
+ *
+ * @brief Compile-time lookup table from ADC code to
+ * temperature, built from calibration points.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TempTable.h"
+#include <stddef.h>
+
+/**
+ * LM35: 10 mV per degree C, read by a 12-bit ADC with a 3.3 V
+ * reference. Code 4095 is 4095*3300/4096/10 = 329.9 degrees C.
+ */
+static constexpr CalPoint default_cal[] = {
+        {0, 0},
+        {4095, 3299},
+};
+
+/** Built by the compiler and placed in flash */
+static constexpr TempLUT default_table =
+        makeTempLUT(default_cal, sizeof(default_cal) / sizeof(default_cal[0]));
+
+#if TEMP_RUNTIME_CAL
+/** Marks a valid calibration record ("TCAL") */
+static const uint32_t CAL_MAGIC = 0x4C414354;
+
+/** Calibration record kept at the start of the last flash sector */
+struct CalRecord {
+    uint32_t magic;
+    uint32_t count;
+    CalPoint points[TEMP_CAL_MAX_POINTS];
+    uint32_t checksum;
+};
+
+/** @return a simple checksum over everything before the checksum field */
+static uint32_t cal_checksum(const CalRecord &record) {
+    const uint8_t *bytes = (const uint8_t *)&record;
+    uint32_t sum = 0x12345678;
+    for (size_t i = 0; i < offsetof(CalRecord, checksum); i++)
+        sum = (sum << 5) + (sum >> 27) + bytes[i];
+    return sum;
+}
+
+/** @return whether the points can build a table */
+static bool cal_valid(const CalPoint *points, int count) {
+    if (count < 2 || count > TEMP_CAL_MAX_POINTS)
+        return false;
+    for (int i = 1; i < count; i++) {
+        if (points[i].code <= points[i - 1].code)
+            return false;
+    }
+    return true;
+}
+
+static TempLUT ram_table;
+
+/** @return address of the last flash sector */
+static uint32_t cal_address(FlashIAP &flash) {
+    uint32_t end = flash.get_flash_start() + flash.get_flash_size();
+    return end - flash.get_sector_size(end - 1);
+}
+#endif
+
+TempTable::TempTable() : _c(default_table.c), _f(default_table.f) {
+}
+
+#if TEMP_RUNTIME_CAL
+bool TempTable::loadCalibration() {
+    FlashIAP flash;
+    CalRecord record;
+
+    if (flash.init() != 0)
+        return false;
+    int result = flash.read(&record, cal_address(flash), sizeof(record));
+    flash.deinit();
+
+    if (result != 0 || record.magic != CAL_MAGIC || record.checksum != cal_checksum(record)
+        || !cal_valid(record.points, record.count))
+        return false;
+
+    ram_table = makeTempLUT(record.points, record.count);
+    _c = ram_table.c;
+    _f = ram_table.f;
+    return true;
+}
+
+bool TempTable::saveCalibration(const CalPoint *points, int count) {
+    if (!cal_valid(points, count))
+        return false;
+
+    CalRecord record = {};
+    record.magic = CAL_MAGIC;
+    record.count = count;
+    for (int i = 0; i < count; i++)
+        record.points[i] = points[i];
+    record.checksum = cal_checksum(record);
+
+    FlashIAP flash;
+    if (flash.init() != 0)
+        return false;
+    uint32_t address = cal_address(flash);
+    int result = flash.erase(address, flash.get_sector_size(address));
+    if (result == 0)
+        result = flash.program(&record, address, sizeof(record));
+    flash.deinit();
+
+    if (result != 0)
+        return false;
+
+    ram_table = makeTempLUT(points, count);
+    _c = ram_table.c;
+    _f = ram_table.f;
+    return true;
+}
+#else
+bool TempTable::loadCalibration() {
+    return false;
+}
+
+bool TempTable::saveCalibration(const CalPoint *, int) {
+    return false;
+}
+#endif
@@ -0,0 +1,145 @@
+/**
+ * @file TempTable.h
+ *
+ * @brief Compile-time lookup table from ADC code to
+ * temperature, built from calibration points.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TEMPTABLE_H
+#define TEMPTABLE_H
+
+#include "mbed.h"
+#include <stdint.h>
+
+/**
+ * @brief Set TEMP_RUNTIME_CAL to 1 to allow a calibration stored
+ * in flash to replace the built-in one at start up. The tables are
+ * then rebuilt in RAM, which costs 16 KB.
+ */
+#ifndef TEMP_RUNTIME_CAL
+#define TEMP_RUNTIME_CAL 0
+#endif
+
+/** Number of ADC codes covered by the table */
+const int TEMP_TABLE_SIZE = 4096;
+
+/** Largest number of calibration points */
+const int TEMP_CAL_MAX_POINTS = 8;
+
+/** One calibration point: the ADC code read at a known temperature */
+struct CalPoint {
+    uint16_t code;      /**< 12-bit ADC code */
+    int16_t tenths_c;   /**< temperature in tenths of a degree C */
+};
+
+/** Temperatures for every ADC code, in tenths of a degree */
+struct TempLUT {
+    int16_t c[TEMP_TABLE_SIZE];
+    int16_t f[TEMP_TABLE_SIZE];
+};
+
+/**
+ * @brief Interpolates a temperature between calibration points.
+ *
+ * Codes outside the points are extrapolated from the nearest
+ * segment. Points must be sorted by code.
+ *
+ * @return temperature in tenths of a degree C, rounded
+ */
+constexpr int calInterpolate(const CalPoint *points, int count, int code) {
+    int i = 0;
+    while (i < count - 2 && code > points[i + 1].code)
+        i++;
+
+    int32_t dx = points[i + 1].code - points[i].code;
+    int32_t dy = points[i + 1].tenths_c - points[i].tenths_c;
+    int32_t num = (code - points[i].code) * dy * 2;
+
+    /** Round half away from zero */
+    int32_t step = num >= 0 ? (num + dx) / (2*dx) : (num - dx) / (2*dx);
+    return points[i].tenths_c + step;
+}
+
+/** @return tenths of a degree C converted to tenths of a degree F, rounded */
+constexpr int tenthsCToF(int tenths_c) {
+    int scaled = tenths_c * 9;
+    return (scaled >= 0 ? (scaled + 2) / 5 : (scaled - 2) / 5) + 320;
+}
+
+/**
+ * @brief Builds the C and F tables from a calibration.
+ *
+ * Usable at compile time, so the default table lives in flash
+ * and costs nothing at start up.
+ */
+constexpr TempLUT makeTempLUT(const CalPoint *points, int count) {
+    TempLUT table{};
+    for (int code = 0; code < TEMP_TABLE_SIZE; code++) {
+        table.c[code] = calInterpolate(points, count, code);
+        table.f[code] = tenthsCToF(table.c[code]);
+    }
+    return table;
+}
+
+/**
+ * @brief Converts filtered ADC codes to temperature with one
+ * table lookup and no floating point.
+ *
+ * The default table is generated at compile time from a two-point
+ * calibration of the LM35 (10 mV per degree C, 3.3 V reference).
+ * With TEMP_RUNTIME_CAL a calibration record in the last flash
+ * sector can replace it at start up.
+ */
+class TempTable {
+public:
+    TempTable();
+
+    /**
+     * @brief Converts a reading to tenths of a degree C.
+     *
+     * The fractional part of the code interpolates between two
+     * neighbouring entries, so oversampling is not lost.
+     *
+     * @param code ADC code in 1/256 of a code
+     */
+    int celsius(uint32_t code) const {
+        return lookup(_c, code);
+    }
+
+    /** Converts a reading to tenths of a degree F, see celsius() */
+    int fahrenheit(uint32_t code) const {
+        return lookup(_f, code);
+    }
+
+    /**
+     * @brief Loads the calibration stored in flash, if any.
+     *
+     * @return true if a valid calibration replaced the built-in one.
+     */
+    bool loadCalibration();
+
+    /**
+     * @brief Stores a calibration in flash and applies it.
+     *
+     * @param points Calibration points, sorted by code (2-8)
+     * @return true on success.
+     */
+    bool saveCalibration(const CalPoint *points, int count);
+
+private:
+    static int lookup(const int16_t *table, uint32_t code) {
+        uint32_t i = code >> 8;
+        if (i >= TEMP_TABLE_SIZE - 1)
+            return table[TEMP_TABLE_SIZE - 1];
+        int frac = code & 0xFF;
+        return table[i] + (((table[i + 1] - table[i]) * frac) >> 8);
+    }
+
+    const int16_t *_c;
+    const int16_t *_f;
+};
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * @file Temperature.cpp
+ *
+ * @brief Temperature acquisition: oversampling and
+ * filtering of the analog temperature sensor.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Temperature.h"
+
+TempAcquisition::TempAcquisition(PinName pin, int oversample, int filter_shift,
+                                 int sample_ms, int publish_ms) :
+        _running(false), _threshold(0), _primed(false), _filter(0), _deviation(0),
+        _drift(0), _published(0), _quiet(0), _since_publish(0), _count(0), _stats(), _hour_ms(0) {
+    analogin_init(&_adc, pin);
+    setOversample(oversample);
+    setFilter(filter_shift);
+    setRates(sample_ms, publish_ms);
+}
+
+void TempAcquisition::start() {
+    sample();
+    _ticker.attach(callback(this, &TempAcquisition::sample), std::chrono::milliseconds(_period_ms));
+    _running = true;
+}
+
+void TempAcquisition::stop() {
+    _ticker.detach();
+    _running = false;
+}
+
+void TempAcquisition::setOversample(int oversample) {
+    if (oversample < 1)
+        oversample = 1;
+    if (oversample > 256)
+        oversample = 256;
+    _oversample = oversample;
+}
+
+void TempAcquisition::setFilter(int filter_shift) {
+    _filter_shift = filter_shift < 0 ? 0 : filter_shift > 12 ? 12 : filter_shift;
+}
+
+void TempAcquisition::setRates(int sample_ms, int publish_ms) {
+    _publish_ms = publish_ms;
+    setAdaptive(sample_ms, sample_ms, 0);
+}
+
+void TempAcquisition::setAdaptive(int fast_ms, int slow_ms, uint32_t threshold, uint32_t budget) {
+    _fast_ms = fast_ms < 1 ? 1 : fast_ms;
+    _slow_ms = slow_ms < _fast_ms ? _fast_ms : slow_ms;
+    _threshold = int32_t(threshold) << 8;
+    _stats.budget = budget;
+    _quiet = 0;
+    setPeriod(_fast_ms);
+}
+
+AcquisitionStats TempAcquisition::stats() const {
+    CriticalSectionLock lock;
+    return _stats;
+}
+
+void TempAcquisition::setPeriod(int period_ms) {
+    _period_ms = period_ms;
+    _stats.period_ms = period_ms;
+    if (_running)
+        _ticker.attach(callback(this, &TempAcquisition::sample), std::chrono::milliseconds(_period_ms));
+}
+
+TempReading TempAcquisition::reading() const {
+    return _latest.load();
+}
+
+uint32_t TempAcquisition::code() const {
+    return _latest.load().code;
+}
+
+void TempAcquisition::sample() {
+    int32_t sample = int32_t(oversample()) << 8;
+
+    if (!_primed) {
+        /** Start the filter at the first sample instead of ramping up from 0 */
+        _filter = sample;
+        _published = sample;
+        _primed = true;
+        _since_publish = _publish_ms;
+    }
+    else {
+        int32_t innovation = sample - _filter;
+        _filter += innovation >> _filter_shift;
+        _deviation += ((innovation < 0 ? -innovation : innovation) - _deviation) >> 3;
+    }
+
+    _stats.samples++;
+    _stats.adc_reads += _oversample;
+    _stats.hour_samples++;
+    _hour_ms += _period_ms;
+    if (_hour_ms >= 3600000) {
+        _stats.last_hour_samples = _stats.hour_samples;
+        _stats.hour_samples = 0;
+        _hour_ms -= 3600000;
+    }
+
+    _since_publish += _period_ms;
+    if (_since_publish >= _publish_ms) {
+        TempReading reading = {uint32_t(_filter >> 8), ++_count};
+        _latest.publish(reading);
+
+        /** Drift is measured between readings; over single samples it is mostly noise */
+        int32_t change = _filter - _published;
+        _drift += (int32_t(int64_t(change) * 60000 / _since_publish) - _drift) >> 2;
+        _published = _filter;
+        _since_publish = 0;
+    }
+
+    if (_fast_ms != _slow_ms)
+        adapt();
+}
+
+void TempAcquisition::adapt() {
+    bool spent = _stats.budget && _stats.hour_samples >= _stats.budget;
+    bool changing = _deviation > _threshold || _drift > _threshold || _drift < -_threshold;
+    int period = _period_ms;
+
+    if (spent)
+        period = _slow_ms;
+    else if (changing) {
+        period = _fast_ms;
+        _quiet = 0;
+    }
+    else if (++_quiet >= BACKOFF_SAMPLES) {
+        period = period*2 > _slow_ms ? _slow_ms : period*2;
+        _quiet = 0;
+    }
+
+    if (period != _period_ms)
+        setPeriod(period);
+}
+
+uint32_t TempAcquisition::oversample() {
+    uint32_t sum = 0;
+
+    /** analogin_read_u16() returns the 12-bit code left aligned in 16 bits */
+    for (int i = 0; i < _oversample; i++)
+        sum += analogin_read_u16(&_adc) >> 4;
+
+    return (uint64_t(sum) << 8) / _oversample;
+}
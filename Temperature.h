@@ -0,0 +1,195 @@
+/**
+ * @file Temperature.h
+ *
+ * @brief Temperature acquisition: oversampling and
+ * filtering of the analog temperature sensor.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TEMPERATURE_H
+#define TEMPERATURE_H
+
+#include "mbed.h"
+#include <stdint.h>
+
+/**
+ * @brief Single-writer slot that always holds the latest value.
+ *
+ * The writer (an interrupt) bumps a sequence number to odd,
+ * stores the value and bumps it back to even. A reader copies
+ * the value and retries if the sequence was odd or changed
+ * under it. Neither side ever waits on a lock, and the writer
+ * never waits at all.
+ */
+template<typename T>
+class LatestValue {
+public:
+    LatestValue() : _sequence(0), _value() {}
+
+    /** Stores a new value; only one context may call this */
+    void publish(const T &value) {
+        _sequence++;
+        MBED_COMPILER_BARRIER();
+        _value = value;
+        MBED_COMPILER_BARRIER();
+        _sequence++;
+    }
+
+    /** @return a consistent copy of the latest value */
+    T load() const {
+        uint32_t before, after;
+        T value;
+        do {
+            before = _sequence;
+            MBED_COMPILER_BARRIER();
+            value = _value;
+            MBED_COMPILER_BARRIER();
+            after = _sequence;
+        } while ((before & 1) || before != after);
+        return value;
+    }
+
+private:
+    volatile uint32_t _sequence;
+    T _value;
+};
+
+/** One published temperature reading */
+struct TempReading {
+    uint32_t code;  /**< filtered ADC code in 1/256 code */
+    uint32_t count; /**< readings published so far */
+};
+
+/** Counters of the work done by a TempAcquisition */
+struct AcquisitionStats {
+    uint32_t samples;           /**< samples taken */
+    uint32_t adc_reads;         /**< ADC conversions, oversampling included */
+    int period_ms;              /**< current time between samples */
+    uint32_t hour_samples;      /**< samples taken in the current hour */
+    uint32_t last_hour_samples; /**< samples taken in the last full hour */
+    uint32_t budget;            /**< most samples per hour, 0 for no limit */
+};
+
+/**
+ * @brief Samples the temperature sensor in the background,
+ * oversampling the ADC and running the result through a
+ * fixed-point exponential moving average.
+ *
+ * A Ticker interrupt takes one sample every sample period: it
+ * reads the ADC oversample times in a burst and averages the
+ * block, which gains about half a bit of resolution per doubling
+ * of the count. The average feeds an EMA whose time constant is
+ * 2^filter_shift samples. Once every publish period the filtered
+ * value goes into a LatestValue slot, so the renderer just loads
+ * the latest reading and never waits on a conversion.
+ *
+ * With setAdaptive() the sample period follows the signal. A
+ * sample whose filtered deviation from the EMA, or the filtered
+ * drift per minute between readings, exceeds the threshold drops the period straight to
+ * the fast rate. Every BACKOFF_SAMPLES quiet samples in a row
+ * double it, up to the slow floor. An hourly budget caps the
+ * number of samples; once it is spent the sampler stays at the
+ * floor until the hour is over. Readings are still published
+ * once per publish period, or every sample when samples are
+ * further apart than that.
+ *
+ * The ADC is read through the HAL analogin API because AnalogIn
+ * takes a mutex, which is not allowed in an interrupt. With the
+ * defaults a burst of 64 reads takes well under 0.2 ms.
+ *
+ * Values are ADC codes (0-4095) in 1/256 of a code.
+ */
+class TempAcquisition {
+public:
+
+    /**
+     * @param pin          ADC pin of the temperature sensor
+     * @param oversample   ADC reads averaged per sample (1-256)
+     * @param filter_shift EMA time constant as a power of two, in samples
+     * @param sample_ms    Time between samples
+     * @param publish_ms   Time between published readings
+     */
+    TempAcquisition(PinName pin, int oversample = 64, int filter_shift = 4,
+                    int sample_ms = 100, int publish_ms = 1000);
+
+    /** Takes the first sample and starts background sampling */
+    void start();
+
+    /** Stops background sampling */
+    void stop();
+
+    /** Sets the number of ADC reads averaged per sample (1-256) */
+    void setOversample(int oversample);
+
+    /** Sets the EMA time constant to 2^filter_shift samples */
+    void setFilter(int filter_shift);
+
+    /**
+     * @brief Sets a fixed sample period and the publish period;
+     * turns adaptive sampling off.
+     */
+    void setRates(int sample_ms, int publish_ms);
+
+    /**
+     * @brief Lets the sample period adapt between fast_ms and
+     * slow_ms.
+     *
+     * @param fast_ms   Sample period while the temperature changes
+     * @param slow_ms   Longest sample period while it is stable
+     * @param threshold Deviation, and drift per minute, that count
+     *                  as a change, in 1/256 ADC code
+     * @param budget    Most samples per hour, 0 for no limit
+     */
+    void setAdaptive(int fast_ms, int slow_ms, uint32_t threshold, uint32_t budget = 0);
+
+    /** @return the sampling counters */
+    AcquisitionStats stats() const;
+
+    /** @return the latest published reading */
+    TempReading reading() const;
+
+    /** @return the latest published reading, ADC code in 1/256 code */
+    uint32_t code() const;
+
+private:
+    /** Quiet samples in a row before the sample period doubles */
+    static const int BACKOFF_SAMPLES = 8;
+
+    /** Ticker interrupt: one oversampled, filtered sample */
+    void sample();
+
+    /** Picks the next sample period from the deviation and drift */
+    void adapt();
+
+    /** Moves the ticker to a new sample period */
+    void setPeriod(int period_ms);
+
+    /** @return the average of oversample ADC reads, in 1/256 code */
+    uint32_t oversample();
+
+    analogin_t _adc;
+    Ticker _ticker;
+    bool _running;
+
+    int _oversample, _filter_shift;
+    int _period_ms, _fast_ms, _slow_ms, _publish_ms;
+    int32_t _threshold; /**< 1/65536 code */
+
+    bool _primed;
+    int32_t _filter;    /**< EMA state, 1/65536 code */
+    int32_t _deviation; /**< filtered |sample - EMA|, 1/65536 code */
+    int32_t _drift;     /**< filtered EMA change per minute, 1/65536 code */
+    int32_t _published; /**< EMA state at the last reading */
+    int _quiet;         /**< quiet samples in a row */
+    int _since_publish; /**< ms since the last reading */
+    uint32_t _count;
+
+    AcquisitionStats _stats;
+    int _hour_ms;       /**< ms into the current budget hour */
+
+    LatestValue<TempReading> _latest;
+};
+
+#endif
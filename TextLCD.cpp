@@ -31,7 +31,7 @@ void wait(float sec){
 TextLCD::TextLCD(PinName rs, PinName e, PinName d4, PinName d5,
                  PinName d6, PinName d7, LCDType type) : _rs(rs),
         _e(e), _d(d4, d5, d6, d7),
-        _type(type) {
+        _type(type), _last_write(0), _address(-1) {
 
     _e  = 1;
     _rs = 0;            // command mode
@@ -53,14 +53,25 @@ TextLCD::TextLCD(PinName rs, PinName e, PinName d4, PinName d5,
 }
 
 void TextLCD::character(int column, int row, int c) {
+    int i = row * columns() + column;
+    if (_screen[i] == (char)c) {
+        return;         // already on the screen
+    }
+    _screen[i] = c;
+
     int a = address(column, row);
-    writeCommand(a);
+    if (a != _address) {
+        writeCommand(a);
+    }
     writeData(c);
+    _address = a + 1;   // the LCD moves its cursor right after each write
 }
 
 void TextLCD::cls() {
     writeCommand(0x01); // cls, and set cursor to 0
     wait(0.00164f);     // This command takes 1.64 ms
+    memset(_screen, ' ', sizeof(_screen));
+    _address = 0x80;
     locate(0, 0);
 }
 
@@ -94,6 +105,19 @@ int TextLCD::_getc() {
     return -1;
 }
 
+void TextLCD::setUDC(int index, const char *pattern) {
+    writeCommand(0x40 + ((index & 0x07) << 3)); // set CGRAM address
+    for (int i=0; i<8; i++) {
+        writeData(pattern[i]);
+    }
+    _address = address(_column, _row);
+    writeCommand(_address);                     // back to DDRAM
+}
+
+unsigned int TextLCD::lastWrite() {
+    return _last_write;
+}
+
 void TextLCD::writeByte(int value) {
     _d = value >> 4;
     wait(0.000040f); // most instructions take 40us
@@ -105,6 +129,7 @@ void TextLCD::writeByte(int value) {
     _e = 0;
     wait(0.000040f);  // most instructions take 40us
     _e = 1;
+    _last_write = us_ticker_read();
 }
 
 void TextLCD::writeCommand(int command) {
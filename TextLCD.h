@@ -29,6 +29,11 @@
  *
  * Currently supports 16x2, 20x2 and 20x4 panels
  *
+ * A copy of the screen is kept in RAM and a character that is
+ * already on the screen is not sent again, so redrawing a whole
+ * line only puts the changed characters on the bus. The address
+ * command is skipped too when the LCD's cursor is already there.
+ *
  * @code
  * #include "mbed.h"
  * #include "TextLCD.h"
@@ -88,6 +93,22 @@ public:
     int rows();
     int columns();
 
+    /** Define a user defined character in CGRAM
+     *
+     * The character is shown by writing its index, e.g. putc(0).
+     *
+     * @param index   Character code to define, 0-7
+     * @param pattern 8 rows of 5 pixels, top row first, bit 4 leftmost
+     */
+    void setUDC(int index, const char *pattern);
+
+    /** Time the last byte finished on the bus
+     *
+     * @returns us_ticker time, in microseconds, at which the most
+     *          recent write to the LCD completed
+     */
+    unsigned int lastWrite();
+
 protected:
 
     // Stream implementation functions
@@ -106,6 +127,10 @@ protected:
 
     int _column;
     int _row;
+    unsigned int _last_write;
+
+    char _screen[4*20];     // characters on the display
+    int _address;           // DDRAM address the next data byte goes to, -1 if unknown
 };
 
 #endif
@@ -0,0 +1,105 @@
+/**
+ * @file TimeZone.cpp
+ *
+ * @brief Time zones with daylight saving time, from transition
+ * tables built at compile time.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TimeZone.h"
+#include <stddef.h>
+
+/** EU: last Sunday of March to last Sunday of October, 01:00 UTC */
+static constexpr DstChange eu_start = {3, 5, 60, true};
+static constexpr DstChange eu_end = {10, 5, 60, true};
+
+/** US: second Sunday of March to first Sunday of November, 02:00 local */
+static constexpr DstChange us_start = {3, 2, 120, false};
+static constexpr DstChange us_end = {11, 1, 120, false};
+
+/** South-east Australia: first Sunday of October to first Sunday of April */
+static constexpr DstChange au_start = {10, 1, 120, false};
+static constexpr DstChange au_end = {4, 1, 180, false};
+
+/** Built by the compiler and placed in flash */
+static constexpr TimeZoneTable london = makeTimeZoneTable({0, 60, eu_start, eu_end});
+static constexpr TimeZoneTable berlin = makeTimeZoneTable({60, 60, eu_start, eu_end});
+static constexpr TimeZoneTable new_york = makeTimeZoneTable({-300, 60, us_start, us_end});
+static constexpr TimeZoneTable chicago = makeTimeZoneTable({-360, 60, us_start, us_end});
+static constexpr TimeZoneTable denver = makeTimeZoneTable({-420, 60, us_start, us_end});
+static constexpr TimeZoneTable los_angeles = makeTimeZoneTable({-480, 60, us_start, us_end});
+static constexpr TimeZoneTable sydney = makeTimeZoneTable({600, 60, au_start, au_end});
+
+static const int DST_CHANGES = 2*TZ_YEARS;
+
+static const TimeZone time_zones[] = {
+        {"UTC", "UTC", "UTC", 0, 0, NULL, 0},
+        {"London", "GMT", "BST", 0, 60, london.changes, DST_CHANGES},
+        {"Berlin", "CET", "CEST", 60, 60, berlin.changes, DST_CHANGES},
+        {"New York", "EST", "EDT", -300, 60, new_york.changes, DST_CHANGES},
+        {"Chicago", "CST", "CDT", -360, 60, chicago.changes, DST_CHANGES},
+        {"Denver", "MST", "MDT", -420, 60, denver.changes, DST_CHANGES},
+        {"Phoenix", "MST", "MST", -420, 0, NULL, 0},
+        {"Los Angeles", "PST", "PDT", -480, 60, los_angeles.changes, DST_CHANGES},
+        {"Kolkata", "IST", "IST", 330, 0, NULL, 0},
+        {"Sydney", "AEST", "AEDT", 600, 60, sydney.changes, DST_CHANGES},
+};
+
+int timeZoneCount() {
+    return sizeof(time_zones) / sizeof(time_zones[0]);
+}
+
+const TimeZone &timeZone(int index) {
+    return time_zones[index];
+}
+
+LocalTime::LocalTime(int zone) {
+    setZone(zone);
+}
+
+void LocalTime::setZone(int zone) {
+    _zone = zone;
+    _dst = false;
+    _offset = timeZone(zone).offset*60;
+
+    /** An empty range makes the next conversion look the offset up */
+    _from = 0;
+    _until = 0;
+}
+
+time_t LocalTime::toUtc(time_t local) {
+    time_t utc = local - zone().offset*60;
+    return local - (toLocal(utc) - utc);
+}
+
+void LocalTime::lookup(time_t utc) {
+    const TimeZone &tz = zone();
+    _from = INT64_MIN;
+    _until = INT64_MAX;
+    _dst = false;
+
+    if (tz.count > 0) {
+        /** Number of changes at or before utc */
+        int low = 0, high = tz.count;
+        while (low < high) {
+            int mid = (low + high) / 2;
+            if (int64_t(tz.changes[mid] & ~1u) <= utc)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        if (low > 0) {
+            _from = tz.changes[low - 1] & ~1u;
+            _dst = tz.changes[low - 1] & 1;
+        }
+        else
+            _dst = !(tz.changes[0] & 1);
+        if (low < tz.count)
+            _until = tz.changes[low] & ~1u;
+    }
+
+    _offset = (tz.offset + (_dst ? tz.dst : 0))*60;
+}
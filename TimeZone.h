@@ -0,0 +1,176 @@
+/**
+ * @file TimeZone.h
+ *
+ * @brief Time zones with daylight saving time, from transition
+ * tables built at compile time.
+ *
+ * This header has no mbed dependencies so the same code
+ * runs on the device and on a host computer.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TIMEZONE_H
+#define TIMEZONE_H
+
+#include "Calendar.h"
+#include <stdint.h>
+#include <time.h>
+
+/** First year covered by the transition tables */
+const int TZ_FIRST_YEAR = 2020;
+
+/** Years covered; outside them the offset stays at the nearest table end */
+const int TZ_YEARS = 80;
+
+/** One daylight saving time change, repeated every year */
+struct DstChange {
+    uint8_t month;      /**< 1..12 */
+    uint8_t week;       /**< 1..4 for the nth Sunday, 5 for the last one */
+    int16_t minute;     /**< time of day of the change, in minutes */
+    bool utc;           /**< minute is UTC rather than the local time before the change */
+};
+
+/** Rule of a time zone */
+struct TimeZoneRule {
+    int16_t offset;     /**< standard time, minutes east of UTC */
+    int16_t dst;        /**< minutes added in DST, 0 if the zone has none */
+    DstChange start, end;
+};
+
+/**
+ * @brief Every DST change of a zone over TZ_YEARS, sorted.
+ *
+ * Each entry is the UTC time of a change in seconds since 1970.
+ * Changes fall on whole minutes, so the time is even and bit 0
+ * holds whether DST is in force after the change.
+ */
+struct TimeZoneTable {
+    uint32_t changes[2*TZ_YEARS];
+};
+
+/** @return day count of the Sunday a change falls on in a year */
+constexpr int32_t dstChangeDay(int year, const DstChange &change) {
+    if (change.week == 5) {
+        int32_t last = daysFromCivil(year, change.month, daysInMonth(year, change.month));
+        return last - weekdayFromDays(last);
+    }
+    int32_t first = daysFromCivil(year, change.month, 1);
+    return first + (7 - weekdayFromDays(first)) % 7 + 7*(change.week - 1);
+}
+
+/**
+ * @return UTC time of a change in a year
+ *
+ * @param before Offset in force before the change, in minutes
+ */
+constexpr uint32_t dstChangeTime(int year, const DstChange &change, int before) {
+    int32_t minute = change.minute - (change.utc ? 0 : before);
+    return uint32_t(dstChangeDay(year, change)) * SECONDS_PER_DAY + minute*60;
+}
+
+/**
+ * @brief Builds the table of a zone with DST.
+ *
+ * Usable at compile time, so the tables live in flash and nothing
+ * is parsed or worked out on the device.
+ */
+constexpr TimeZoneTable makeTimeZoneTable(const TimeZoneRule &rule) {
+    TimeZoneTable table{};
+    for (int i = 0; i < TZ_YEARS; i++) {
+        uint32_t start = dstChangeTime(TZ_FIRST_YEAR + i, rule.start, rule.offset) | 1;
+        uint32_t end = dstChangeTime(TZ_FIRST_YEAR + i, rule.end, rule.offset + rule.dst);
+
+        /** South of the equator DST ends before it starts again */
+        table.changes[2*i] = start < end ? start : end;
+        table.changes[2*i + 1] = start < end ? end : start;
+    }
+    return table;
+}
+
+/** A time zone the clock can show */
+struct TimeZone {
+    const char *name;
+    const char *standard;   /**< abbreviation in standard time */
+    const char *daylight;   /**< abbreviation in DST */
+    int16_t offset;         /**< standard time, minutes east of UTC */
+    int16_t dst;            /**< minutes added in DST */
+    const uint32_t *changes;
+    int count;              /**< entries in changes, 0 if the zone has no DST */
+};
+
+/** @return number of zones built into the program */
+int timeZoneCount();
+
+/** @return one of the built-in zones */
+const TimeZone &timeZone(int index);
+
+/**
+ * @brief Converts between UTC and the local time of a zone.
+ *
+ * A lookup finds the offset with a binary search over the zone's
+ * changes and keeps the range of UTC times it holds for. Until the
+ * next change, or a jump of the clock, each conversion is then a
+ * range check and an add.
+ *
+ * @code
+ * LocalTime local_time(3);
+ * time_t local = local_time.toLocal(time(NULL));
+ * @endcode
+ */
+class LocalTime {
+public:
+
+    /** @param zone Index of a built-in zone */
+    LocalTime(int zone = 0);
+
+    /** @brief Switches to another built-in zone */
+    void setZone(int zone);
+
+    /** @return index of the zone in use */
+    int zoneIndex() const {
+        return _zone;
+    }
+
+    /** @return the zone in use */
+    const TimeZone &zone() const {
+        return timeZone(_zone);
+    }
+
+    /** @return local time of a UTC time, both in seconds since 1970 */
+    time_t toLocal(time_t utc) {
+        if (utc < _from || utc >= _until)
+            lookup(utc);
+        return utc + _offset;
+    }
+
+    /**
+     * @return UTC time of a local time. A local time in the hour
+     * skipped or repeated by a DST change resolves to one of its
+     * possible readings.
+     */
+    time_t toUtc(time_t local);
+
+    /** @return true if DST was in force at the last conversion */
+    bool dst() const {
+        return _dst;
+    }
+
+    /** @return abbreviation of the zone at the last conversion */
+    const char *abbreviation() const {
+        return _dst ? zone().daylight : zone().standard;
+    }
+
+private:
+
+    /** Finds the offset at a time and the range it holds for */
+    void lookup(time_t utc);
+
+    int _zone;
+    bool _dst;
+    int32_t _offset;
+    int64_t _from, _until;
+};
+
+#endif
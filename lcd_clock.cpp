@@ -13,6 +13,24 @@
 
 #include "mbed.h"
 #include "TextLCD.h"
+#include "Keypad.h"
+#include "TCA8418.h"
+#include "Latency.h"
+#include "Temperature.h"
+#include "TempTable.h"
+#include "TempStats.h"
+#include "TempSensor.h"
+#include "AnalogTempSensor.h"
+#include "OneWire.h"
+#include "Sparkline.h"
+#include "TempLog.h"
+#include "Calendar.h"
+#include "TimeZone.h"
+#include "Alarm.h"
+#include "Stopwatch.h"
+#include "SerialCommand.h"
+#include "SerialOutput.h"
+#include "FlashIAPBlockDevice.h"
 #include <string>
 
 /**
@@ -28,28 +46,156 @@
  */
 TextLCD lcd(PA_0, PA_1, PA_4, PB_0, PC_1, PC_0);
 
+/**
+ * @brief Every piece of work in the program runs as an event on
+ * this queue. Interrupts only post events, and the core sleeps
+ * whenever the queue is empty.
+ */
+EventQueue queue(32 * EVENTS_EVENT_SIZE);
+
+/**
+ * @brief Share of time the core spends outside event handlers.
+ *
+ * Only the handlers are timed, through Busy. Interrupt handlers
+ * are not: the TempAcquisition Ticker's burst of ADC reads, the
+ * keypad column interrupt and the UART RX and TX interrupts count
+ * as idle unless they land inside an event handler. So idle= is
+ * an upper bound on the real idle time.
+ *
+ * The old polling loop never slept, so it would have read 0%. On
+ * the normal screen the handlers are the secondTick edge spin of
+ * up to EDGE_GUARD_MS, a redraw of a few LCD bytes and ten short
+ * sensorTick events per second. tools/duty_sim.cpp runs that
+ * schedule, with estimated costs, through this meter.
+ */
+IdleMeter cpu_idle;
+
+/**
+ * @brief Times one event handler for cpu_idle; declare one at
+ * the top of every handler the queue calls.
+ */
+struct Busy {
+    Busy() { cpu_idle.begin(us_ticker_read()); }
+    ~Busy() { cpu_idle.end(us_ticker_read()); }
+};
+
+/** Free-running clock for the keypad, sensors and display */
+Timer uptime;
+
+/** @return milliseconds on uptime; wraps after 49 days like the callers expect */
+uint32_t uptimeMs(void){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(uptime.elapsed_time()).count();
+}
+
 /**
  * @brief This instantiates the temperature
  * sensor analog input pin.
  *
+ * It is sampled in the background. Each sample averages 64 ADC
+ * reads and is filtered with a time constant of 16 samples. A new
+ * reading is published once per second, or every sample while
+ * samples are further apart.
+ *
  */
-AnalogIn temp_sensor(PC_2);
+TempAcquisition temp_sensor(PC_2, 64, 4, 100, 1000);
 
 /**
- * @brief DigitalOut instantiates the GPIO pin objects that
- * read the rows of the 4x4 keypad
- *
- * They are set as output pins.
+ * Adaptive sampling: every 100 ms while the temperature moves by
+ * more than 4 ADC codes (about 0.3 C) or 4 codes a minute, backing
+ * off to once every 6.4 s while it is stable, and at most 6000
+ * samples an hour.
  */
-DigitalOut rows[] = {(PA_6), (PA_7), (PB_6), (PC_7)}; // array of GPIO pin objects -- set to out
+const int SAMPLE_FAST_MS = 100;
+const int SAMPLE_SLOW_MS = 6400;
+const uint32_t SAMPLE_THRESHOLD = 4*256;
+const uint32_t SAMPLE_BUDGET = 6000;
 
 /**
- * @brief DigitalIn instantiates the GPIO pin objects that
- * read the columns of the keypad.
- *
- * They are input pins.
+ * @brief Lookup table from the sensor's ADC code to
+ * tenths of a degree, built at compile time.
+ */
+TempTable temp_table;
+
+/** Seconds between two samples of the statistics */
+const int STATS_PERIOD = 60;
+
+/**
+ * @brief Rolling 24 hour statistics of the temperature,
+ * one sample per minute in tenths of a degree C.
+ */
+RollingStats<24*60> temp_stats;
+
+/**
+ * @brief Per minute, per hour and per day rollups of every
+ * published reading, in tenths of a degree C.
+ */
+TempHistory<> temp_history;
+
+/**
+ * @brief Slope of the temperature over the last 10 minutes,
+ * sampled once a second, in tenths of a degree C per sample.
+ */
+TrendEstimator<600> temp_trend;
+
+/** Trend samples per hour, to turn the trend slope into a rate */
+const int READINGS_PER_HOUR = 3600;
+
+/** Rates below this, in tenths of a degree C per hour, show as steady */
+const int TREND_STEADY = 5;
+
+/**
+ * @brief Holds the temperature shown on the LCD steady until the
+ * reading moves 0.3 degrees past the rounding edge, and for at
+ * least 10 seconds after each change.
+ */
+Hysteresis temp_gate(3, 10000);
+
+/** CGRAM character holding the trend arrow */
+const int TREND_GLYPH = 0;
+
+/**
+ * @brief Bar graph of the last 16 per minute temperature
+ * samples; a 1 degree span fills the full height. Its bars use
+ * CGRAM characters 1 to 7.
  */
-DigitalIn cols[] = {(PA_9), (PA_8), (PB_10), (PB_4)}; // array of GPIO pin objects -- set to in
+Sparkline<16> temp_spark(10);
+const int SPARK_GLYPH = 1;
+
+/** What the second line of the normal screen shows */
+enum {STATS_PAGE, SPARK_PAGE};
+
+/** Arrow patterns for a falling, steady and rising temperature */
+const char trend_arrows[3][8] = {
+    {0x04, 0x04, 0x04, 0x04, 0x15, 0x0E, 0x04, 0x00},
+    {0x00, 0x04, 0x02, 0x1F, 0x02, 0x04, 0x00, 0x00},
+    {0x04, 0x0E, 0x15, 0x04, 0x04, 0x04, 0x04, 0x00},
+};
+
+/**
+ * Flash given to the temperature log: sectors 5 and 6 of the
+ * STM32F401RE (128 KB each). The last sector holds the sensor
+ * calibration and the program lives below 0x08020000, which
+ * mbed_app.json enforces by limiting the ROM region the linker
+ * may fill.
+ */
+#ifndef TEMP_LOG_ADDRESS
+#define TEMP_LOG_ADDRESS 0x08020000
+#endif
+#ifndef TEMP_LOG_SIZE
+#define TEMP_LOG_SIZE 0x40000
+#endif
+
+#if defined(MBED_ROM_START) && defined(MBED_ROM_SIZE)
+static_assert(MBED_ROM_START + MBED_ROM_SIZE <= TEMP_LOG_ADDRESS,
+              "program flash overlaps the temperature log, see target.mbed_rom_size in mbed_app.json");
+#endif
+
+/**
+ * @brief Compressed history of the per minute temperature
+ * samples, kept in flash across resets.
+ */
+FlashIAPBlockDevice log_flash(TEMP_LOG_ADDRESS, TEMP_LOG_SIZE);
+TempLog temp_log(log_flash);
 
 /**
  * @brief This instantiates the interrupt used to toggle the
@@ -57,116 +203,366 @@ DigitalIn cols[] = {(PA_9), (PA_8), (PB_10), (PB_4)}; // array of GPIO pin objec
  */
 InterruptIn button(PC_13, PullUp);
 
+/** Pins driving the rows of the 4x4 keypad -- set to out */
+constexpr PinName row_pins[] = {PA_6, PA_7, PB_6, PC_7};
+
+/** Pins reading the columns of the 4x4 keypad -- set to in */
+constexpr PinName col_pins[] = {PA_9, PA_8, PB_10, PB_4};
+
 /** Array of keypad values for user input */
-char key_map [4][4] = {
+constexpr char key_map [4][4] = {
         {'1', '2', '3', 'A'}, //1st row
         {'4', '5', '6', 'P'}, //2nd row
         {'7', '8', '9', 'M'}, //3rd row
         {'*', '0', '#', 'D'}, //4th row
 };
 
+/** Time given to a row line to settle before the columns are read */
+const int ROW_SETTLE_US = 20;
 
 /**
- * @brief Scans the columns of the keypad.
- *
- * This checks to see if the input pins are low (if
- * a button is pressed).
- *
- * @return Index of a button press or a "null character".
+ * @brief Set KEYPAD_TCA8418 to 1 to read the keypad through a
+ * TCA8418 scanner chip instead of scanning it on the GPIO pins.
  */
-int col_scan(void){
-    for(int i=0; i<4; i++){
-        if(cols[i].read() == 0)
-            return i;
-    }
-    return -1;
-}
+#ifndef KEYPAD_TCA8418
+#define KEYPAD_TCA8418 0
+#endif
 
+#if KEYPAD_TCA8418
 /**
- * @brief Function scans the rows of the keypad and calls
- * the col_scan function.
+ * @brief Instantiates the I2C bus and the TCA8418 keypad scanner.
  *
- * This function also acts as a button debounce when a button
- * is pressed.
+ * The keypad rows go to R0-R3 and the columns to C0-C3 of the
+ * chip. Its INT output is wired to PB_5.
+ */
+I2C i2c(PB_9, PB_8);
+InterruptIn keypad_int(PB_5, PullUp);
+TCA8418Keypad<4, 4, I2C, InterruptIn, MbedKeypadPlatform> keypad(i2c, keypad_int, key_map);
+#else
+/**
+ * @brief Instantiates the 4x4 keypad scanner.
  *
- * @return a null character ('x') if no keys are pressed,
- * or return the character pressed.
+ * The rows are driven as outputs and the columns are
+ * read with pull-ups, one read per GPIO port and row.
  */
-char keypadScan(void){
-    static int row_col[] = {-1, -1};
-    static int last_key[] = {-1, -1};
-    int delay = 4;
-    bool noKeyPressed = true;
-    static Timer debounceTimer;
-    const int debounce_time = 500
+MatrixKeypad<4, 4> keypad(row_pins, col_pins, key_map, ROW_SETTLE_US);
+#endif
 
-    for(int i=0; i<4; i++){
-        rows[i].write(0);
-        ThisThread::sleep_for(chrono::milliseconds(delay));
-        row_col[1] = col_scan();
-        ThisThread::sleep_for(chrono::milliseconds(delay));
-        rows[i].write(1);
+/**
+ * @brief Set TEMP_SENSOR_DS18B20 to 1 to read the temperature
+ * from a DS18B20 on a 1-Wire bus on PA_10, or TEMP_SENSOR_TMP1XX
+ * to 1 to read it from a TMP102/TMP112 on the I2C bus. Otherwise
+ * the analog sensor on PC_2 is used.
+ */
+#ifndef TEMP_SENSOR_DS18B20
+#define TEMP_SENSOR_DS18B20 0
+#endif
+#ifndef TEMP_SENSOR_TMP1XX
+#define TEMP_SENSOR_TMP1XX 0
+#endif
 
-        if(row_col[1] > -1){
-            row_col[0] = i;
-            noKeyPressed = false;
-            debounceTimer.start();
-            break;
-        }
-    }
+#if TEMP_SENSOR_DS18B20
+OneWire one_wire(PA_10);
+DS18B20Sensor<OneWire> temp_probe(one_wire);
+#elif TEMP_SENSOR_TMP1XX
+#if !KEYPAD_TCA8418
+I2C i2c(PB_9, PB_8);
+#endif
+TMP1xxSensor<I2C> temp_probe(i2c);
+#else
+AnalogTempSensor temp_probe(temp_sensor, temp_table);
+#endif
 
-    /** No key pressed */
-    if (noKeyPressed) {
-        last_key[0] = -1;
-        last_key[1] = -1;
-        return 'x';
-    }
+/**
+ * @brief Reads the temperature sensors once a second without
+ * blocking. The first sensor is the one shown on the LCD.
+ */
+TempSensorScheduler temp_sensors(1000);
+
+/** Time between two keypad scans; four scans make up the debounce time */
+const int SCAN_PERIOD_MS = 5;
 
-    /** If the same key is pressed again or the debounce time is not elapsed, return no key */
-    if ((last_key[0] == row_col[0] && last_key[1] == row_col[1]) || debounceTimer.read_ms() < debounce_time) {
-        return 'x';
+/**
+ * @brief Scans the keypad and hands its key events to handleKey().
+ *
+ * The keypad is sampled once every SCAN_PERIOD_MS while a key is
+ * down. Every row is read in full, so all 16 keys are seen on each
+ * pass and several keys can be held at once. The keypad debounces
+ * every key on its own and turns the debounced presses and releases
+ * into key events, including auto-repeat and long-press events for
+ * held keys.
+ *
+ * Keys that could be ghosts (see ghostMask()) keep their last
+ * debounced state until the rectangle is broken up.
+ *
+ * Once the keypad is idle the scan stops, and the next key press
+ * restarts it from the column (or TCA8418 INT) interrupt, so an
+ * untouched keypad costs no CPU time at all.
+ *
+ * With KEYPAD_TCA8418 the chip scans and debounces the keypad,
+ * and each update only drains its event FIFO.
+ */
+void keypadTick(void);
+
+/** True while keypadTick() is posted */
+bool keypad_scanning = false;
+
+/** Starts scanning the keypad if it is not scanned already */
+void keypadWake(void){
+    if(!keypad_scanning){
+        keypad_scanning = true;
+        queue.call(keypadTick);
     }
+}
 
-    /** Update last key and return the character corresponding to the key press */
-    last_key[0] = row_col[0];
-    last_key[1] = row_col[1];
-    debounceTimer.reset();
-    return key_map[row_col[0]][row_col[1]];
+/** Keypad interrupt: posts keypadWake() */
+void keypadIrq(void){
+    queue.call(keypadWake);
 }
 
 /** These constants act as mode macros **/
 const int HOUR = 0,
           MIN = 1,
           AM_PM = 2,
-          ENTER = 3;
+          ENTER = 3,
+          REPEAT = 4;
 
 /** These constants act as mode macros **/
 const int NORMAL_MODE = 0,
           SET_MODE = 1,
-          ERROR_MODE = 2;
+          ERROR_MODE = 2,
+          ALARM_MODE = 3,
+          TIMER_MODE = 4;
 
 bool toggle = 0;
 
+int mode = NORMAL_MODE, entry_mode = HOUR; /** initializing start mode */
+bool update_LCD = 0; /** this tells the program whether or not to update the screen */
+
+/** Hour and minutes being entered in SET_MODE or ALARM_MODE */
+int hr = 0, mins = 0;
+
+/**
+ * @brief Local date and time of the RTC, stepped forward each
+ * second instead of converted with localtime().
+ */
+Calendar calendar;
+
+/**
+ * @brief The RTC runs in UTC and the clock shows the local time
+ * of one of the zones built into TimeZone.cpp, starting in UTC.
+ */
+LocalTime local_time(0);
+
+/** A short message shows on the second line until this uptime, in ms */
+const int BANNER_MS = 3000;
+uint32_t banner_until = 0;
+char banner[17];
+
+/** Shows a message on the second line for BANNER_MS */
+void showBanner(const char *text){
+    snprintf(banner, sizeof(banner), "%s", text);
+    banner_until = uptimeMs() + BANNER_MS;
+    update_LCD = 1;
+}
+
+/**
+ * @brief Alarms in local time. A single Timeout is armed for the
+ * earliest one, so the second tick does no alarm work at all.
+ */
+const int MAX_ALARMS = 16;
+AlarmScheduler<MAX_ALARMS> alarms;
+Timeout alarm_timer;
+
+/** Longest the alarm Timeout runs before the RTC is read again, so us ticker drift cannot make an alarm late */
+const int ALARM_CHECK_S = 3600;
+
+/** An alarm rings for this long unless a key press silences it first */
+const int ALARM_RING_MS = 60000;
+
+/** Lit while an alarm rings */
+DigitalOut alarm_led(LED1);
+
+/** What is ringing, an alarm or the countdown, and the event that stops it */
+bool alarm_ringing = false;
+char ring_text[17];
+int ring_event = 0;
+
+/** Days of the alarm being entered in ALARM_MODE */
+uint8_t alarm_days = ALARM_ONCE;
+
+/**
+ * @brief Stopwatch and countdown shown in TIMER_MODE as MM:SS.hh.
+ * It keeps running while the clock shows another mode.
+ */
+Stopwatch stopwatch;
+
+/** Minutes the countdown starts from */
+int countdown_minutes = 5;
+
+/** Events that end the countdown and draw the next frame */
+int countdown_event = 0, frame_event = 0;
+
+/** Column of MM:SS.hh on the second line */
+const int STOPWATCH_COLUMN = 4;
+
+/** Hundredths shown by the last frame, -1 before the first one */
+int32_t frame_shown = -1;
+
+/** Frames drawn, and hundredths never shown because a frame ran late */
+uint32_t stopwatch_frames = 0, stopwatch_skipped = 0;
+
+/** Temperature unit characters */
+char C_F[2] = {'C', 'F'};
+
+/** Unit the shown temperature was gated in, and the page on the second line */
+bool shown_toggle = 0;
+int line2_page = STATS_PAGE;
+
+/** Timestamps of the key press being timed in this keypad scan */
+uint32_t key_edge = 0, key_detect = 0, key_dispatch = 0;
+bool key_timed = false;
+
+void render(void);
+
+void redraw(void);
+
 /**
  * @brief This function is used in conjunction
  * with the boolean variable, toggle, for
  * controlling the temperature output unit.
+ *
+ * It runs in the button interrupt and posts a redraw so the
+ * new unit shows at once.
  */
 void temp_toggle(void){
     toggle = toggle == 0 ? 1 : 0;
+    queue.call(redraw);
+}
+
+/**
+ * @brief This function takes the latest reading of the first
+ * sensor in Celsius or Fahrenheit.
+ *
+ * @param toggle
+ * @return Temperature value in tenths of a degree C or F
+ */
+int getTempTenths(int toggle){
+    int tenths_c = temp_sensors.reading(0).tenths_c;
+    return toggle ? tenthsCToF(tenths_c) : tenths_c;
+}
+
+/**
+ * @brief Converts a temperature in tenths of a degree C to whole
+ * degrees in the unit selected by toggle, rounded like the reading
+ * on line 1.
+ *
+ * @param tenths_c
+ * @param toggle
+ * @return Temperature value in C or F
+ */
+int toUnit(int tenths_c, int toggle){
+    return roundTenths(toggle ? tenthsCToF(tenths_c) : tenths_c);
+}
+
+/** Time between two sensor scheduler updates */
+const int SENSOR_POLL_MS = 100;
+
+/**
+ * @brief Advances the sensor scheduler and adds every new reading
+ * to the temperature history.
+ */
+void sensorTick(void){
+    Busy busy;
+    static uint32_t last_count = 0;
+
+    temp_sensors.update(uptimeMs());
+
+    TempSample reading = temp_sensors.reading(0);
+    if(reading.count != last_count){
+        temp_history.add(time(NULL), reading.tenths_c);
+        last_count = reading.count;
+    }
+}
+
+/**
+ * @brief Erases the next flash log block ahead of its use. The
+ * erase stalls the CPU for a second or more, once per filled half
+ * block (weeks apart), so it runs as an event of its own right
+ * after a redraw and never inside secondTick(); the second tick
+ * finds the edge again afterwards.
+ */
+void eraseLog(void){
+    Busy busy;
+    temp_log.eraseAhead();
+}
+
+/**
+ * @brief The trend takes the latest reading once a second and
+ * the statistics, graph and flash log once every STATS_PERIOD
+ * seconds, so they stay evenly spaced however fast the sensor
+ * is read. Full log pages are written to flash one per second,
+ * and a due block erase is posted as a separate event.
+ *
+ * @param now Current time, seconds since the epoch
+ */
+void updateTempStats(uint32_t now){
+    static uint32_t last_second = 0;
+
+    TempSample reading = temp_sensors.reading(0);
+    if(reading.count != 0 && now != last_second){
+        int16_t celsius = reading.tenths_c;
+        temp_trend.add(celsius);
+        if(temp_stats.count() == 0 || now/STATS_PERIOD != last_second/STATS_PERIOD){
+            temp_stats.add(celsius);
+            temp_spark.add(celsius);
+            temp_log.append(now, celsius);
+        }
+        last_second = now;
+    }
+
+    temp_log.service();
+    if(temp_log.eraseDue())
+        queue.call(eraseLog);
+}
+
+/**
+ * @brief Prints the temperature sampling counters over the
+ * serial port.
+ */
+void print_sampling(void){
+    AcquisitionStats stats = temp_sensor.stats();
+    printf("temp samples: %lu (%lu ADC reads), period %d ms\n",
+           (unsigned long)stats.samples, (unsigned long)stats.adc_reads, stats.period_ms);
+    printf("samples/hour: %lu this hour, %lu last hour, budget %lu\n",
+           (unsigned long)stats.hour_samples, (unsigned long)stats.last_hour_samples,
+           (unsigned long)stats.budget);
+}
+
+/**
+ * @brief Loads the arrow for the current trend into the trend
+ * glyph. CGRAM is only rewritten when the direction changes.
+ *
+ * @param rate Trend in tenths of a degree C per hour
+ */
+void showTrend(int rate){
+    static int shown = -1;
+    int direction = rate >= TREND_STEADY ? 2 : rate <= -TREND_STEADY ? 0 : 1;
+    if(direction != shown){
+        lcd.setUDC(TREND_GLYPH, trend_arrows[direction]);
+        shown = direction;
+    }
 }
 
 /**
- * @brief This function reads the GPIO pin value, converts the voltage
- * value to Celsius and optionally converts further to Fahrenheit.
+ * @brief This function returns the latest temperature in whole
+ * degrees Celsius or Fahrenheit.
  *
  * @param toggle
- * @return Temperature value converted from voltage in C or F
+ * @return Temperature value in C or F
  */
 int getTemp(int toggle){
-    if(!toggle)
-        return int((temp_sensor.read()*3300.0)/10.0);
-    return int(((temp_sensor.read()*3300.0)/10.0)*(9.0/5.0))+32;
+    return roundTenths(getTempTenths(toggle));
 }
 
 int index = 0;
@@ -179,209 +575,1024 @@ void reset_entries(void){
     current_entry[1] = '_';
 }
 
+/**
+ * @brief Steps the two digit entry up or down by one,
+ * wrapping around inside the allowed range.
+ *
+ * A blank or out of range entry starts from the low end
+ * when stepping up and from the high end when stepping down.
+ *
+ * @param step +1 or -1
+ * @param low Smallest allowed value
+ * @param high Largest allowed value
+ */
+void step_entry(int step, int low, int high){
+    int value = (current_entry[0] - '0')*10 + (current_entry[1] - '0');
+
+    if(current_entry[0] == '_' || current_entry[1] == '_' || value < low || value > high)
+        value = step > 0 ? low : high;
+    else if(value + step > high)
+        value = low;
+    else if(value + step < low)
+        value = high;
+    else
+        value += step;
+
+    current_entry[0] = '0' + value / 10;
+    current_entry[1] = '0' + value % 10;
+    index = 0;
+}
+
+
+
+/** Key press latency, per stage of the path from a key press to the LCD */
+KeyPathLatency key_latency;
+
+/** Time from the RTC second edge to the last byte of the redraw on the LCD bus */
+LatencyHistogram second_latency;
+
+/** Set while the second tick is locked on to the RTC's edge */
+bool second_locked = false;
+
+/** us_ticker time of the last RTC edge */
+uint32_t second_edge = 0;
 
+/** Seconds redrawn late because the second tick ran after the edge */
+uint32_t late_seconds = 0;
+
+/** Makes the second tick find the edge again; call it after set_time() */
+void unlockSecond(void){
+    second_locked = false;
+}
 
 /**
- * @brief Program entry point.
+ * @brief Adds one key press to the latency histograms.
  *
- * The program is organized as follows:
- *      1 - SET UP
- *          - This initializes all variables and
- *            sets the GPIO settings for keypad
- *      2 - OPERATION
- *          - Keypad scan
- *          - Keypad Press Interpretation
- *          - Time Object Update
- *          - LCD UPDATE
+ * All times are us_ticker times; the LCD bus completion is read
+ * from the TextLCD object.
  *
- * @return 0, This will never be returned.
+ * @param edge Column edge (or scan detection) of the key
+ * @param detect Key press debounced
+ * @param dispatch Key press handled by the state machine
+ * @param render LCD render started
  */
-int main()
-{
-    /** SET UP SECTION */
+void record_key_latency(uint32_t edge, uint32_t detect, uint32_t dispatch, uint32_t render){
+    key_latency.add(edge, detect, dispatch, render, lcd.lastWrite());
+}
 
-    for(int i=0; i<4; i++){
-        rows[i].write(1);
-        cols[i].mode(PullUp);
-    } /** settings for the GPIO pins */
+/** Buffer size for format_alarm(): "12:59P ONCE" plus the terminator */
+const int ALARM_TEXT = 12;
 
-    char key_map_val;
+/**
+ * @brief Writes an alarm as e.g. " 7:30A 7DAY", with the days
+ * per week as entered in ALARM_MODE, so a state word still fits
+ * after it on one line.
+ *
+ * @param text Buffer of ALARM_TEXT characters or more
+ * @param size Size of text
+ * @param alarm Alarm to write
+ */
+void format_alarm(char *text, int size, const Alarm &alarm){
+    const char *days = alarm.days == ALARM_DAILY ? "7DAY" : alarm.days == ALARM_WEEKDAYS ? "5DAY" : "ONCE";
+    snprintf(text, size, "%2d:%02d%c %s",
+             (alarm.hour % 12 == 0) ? 12 : alarm.hour % 12,
+             alarm.minute,
+             alarm.hour >= 12 ? 'P' : 'A',
+             days);
+}
 
-    /** This is called in start up to initialize the blank characters */
-    reset_entries();
+void alarmTick(void);
 
-    /** Get initial temperature and initialize temp. unit characters */
-    int temp = getTemp(toggle);
-    char C_F[2] = {'C', 'F'};
+/** Alarm Timeout interrupt: posts alarmTick() */
+void alarmIrq(void){
+    queue.call(alarmTick);
+}
 
-    /** Time set up */
-    time_t seconds = time(NULL);
-    struct tm *timeinfo = localtime(&seconds);
-    button.fall(temp_toggle);
-    int hr = 0, min = 0;
+/**
+ * @brief Arms the alarm Timeout for the earliest alarm, or for
+ * ALARM_CHECK_S if that is sooner.
+ */
+void armAlarm(void){
+    alarm_timer.detach();
+    if(alarms.count() == 0)
+        return;
 
+    time_t wait = local_time.toUtc(alarms.next()) - time(NULL);
+    if(wait < 1)
+        wait = 1;
+    if(wait > ALARM_CHECK_S)
+        wait = ALARM_CHECK_S;
+    alarm_timer.attach(alarmIrq, std::chrono::seconds(wait));
+}
 
-    static Timer timer;
-    timer.start();
+/** Works out every alarm again after the clock or time zone changed */
+void rescheduleAlarms(void){
+    alarms.reschedule(local_time.toLocal(time(NULL)));
+    armAlarm();
+}
 
-    int mode = NORMAL_MODE, entry_mode = HOUR; /** initializing start mode */
-    bool update_LCD = 0; /** this tells the program whether or not to update the screen */
+/** Stops a ringing alarm */
+void silenceAlarm(void){
+    alarm_ringing = false;
+    alarm_led = 0;
+    queue.cancel(ring_event);
+    ring_event = 0;
+    update_LCD = 1;
+}
 
-    /** OPERATION SECTION */
-    while (1) {
+/** Stops the alarm once it has rung for ALARM_RING_MS */
+void ringTimeout(void){
+    Busy busy;
+    ring_event = 0;
+    silenceAlarm();
+    render();
+}
 
-        /**
-         * The program constantly scans for key presses
-         */
-        key_map_val = keypadScan();
+/**
+ * @brief Lights the alarm LED and shows a message until a key
+ * press or ALARM_RING_MS.
+ */
+void ring(const char *text){
+    snprintf(ring_text, sizeof(ring_text), "%s", text);
+    alarm_ringing = true;
+    alarm_led = 1;
+    queue.cancel(ring_event);
+    ring_event = queue.call_in(std::chrono::milliseconds(ALARM_RING_MS), ringTimeout);
+    update_LCD = 1;
+    render();
+}
+
+/**
+ * @brief Runs when the alarm Timeout fires: rings every alarm
+ * that is due and arms the Timeout for the next one.
+ */
+void alarmTick(void){
+    Busy busy;
+    Alarm alarm;
+    bool rang = false;
+    while(alarms.take(local_time.toLocal(time(NULL)), alarm))
+        rang = true;
+
+    if(rang){
+        char text[17];
+        snprintf(text, sizeof(text), "ALARM %2d:%02d %cM",
+                 (alarm.hour % 12 == 0) ? 12 : alarm.hour % 12,
+                 alarm.minute,
+                 alarm.hour >= 12 ? 'P' : 'A');
+        ring(text);
+    }
+    armAlarm();
+}
+
+/**
+ * @brief Adds the alarm entered in ALARM_MODE, or removes it if
+ * the same alarm is already set, and shows which on the second line.
+ */
+void saveAlarm(void){
+    Alarm alarm = {(uint8_t)hr, (uint8_t)mins, alarm_days};
+    char text[ALARM_TEXT];
+    format_alarm(text, sizeof(text), alarm);
+
+    const char *state = "ON";
+    int slot = alarms.find(alarm);
+    if(slot >= 0){
+        alarms.remove(slot);
+        state = "OFF";
+    }
+    else if(alarms.add(alarm, local_time.toLocal(time(NULL))) < 0)
+        state = "FULL";
+    armAlarm();
+
+    char line[17];
+    snprintf(line, sizeof(line), "%s %s", text, state);
+    showBanner(line);
+}
+
+/** @brief Prints every alarm and when it rings next over the serial port */
+void print_alarms(void){
+    time_t now = local_time.toLocal(time(NULL));
+    printf("alarms: %d\n", alarms.count());
+    for(int slot = 0; slot < MAX_ALARMS; slot++){
+        if(alarms.used(slot)){
+            char text[ALARM_TEXT];
+            format_alarm(text, sizeof(text), alarms.alarm(slot));
+            printf("%s in %ld s\n", text, (long)(alarms.ringTime(slot) - now));
+        }
+    }
+}
+
+/**
+ * @brief Draws one stopwatch frame: only the MM:SS.hh cells are
+ * written and the LCD driver sends just the digits that changed,
+ * usually one or two bytes and an address command.
+ */
+void stopwatchFrame(void){
+    Busy busy;
+    frame_event = 0;
+    if(mode != TIMER_MODE || !stopwatch.running())
+        return;
 
+    uint32_t shown = stopwatch.hundredths();
+    if(frame_shown >= 0){
+        uint32_t step = abs((int32_t)shown - frame_shown);
+        if(step > 1)
+            stopwatch_skipped += step - 1;
+    }
+    frame_shown = shown;
+    stopwatch_frames++;
+
+    char text[9];
+    Stopwatch::format(shown, text);
+    lcd.locate(STOPWATCH_COLUMN, 1);
+    for(int i = 0; text[i]; i++)
+        lcd.putc(text[i]);
+
+    /** At 99:59.99 the time cannot change again, so stop and show STOP */
+    if(stopwatch.full()){
+        stopwatch.stop();
+        update_LCD = 1;
+        render();
+        return;
+    }
+
+    /**
+     * The next frame is due when the shown time next changes. A
+     * frame held up by other events or the LCD bus just skips the
+     * hundredths it missed; the time itself comes from the Timer
+     * and is never behind.
+     */
+    int wait_ms = (stopwatch.untilChange() + 999) / 1000;
+    frame_event = queue.call_in(std::chrono::milliseconds(wait_ms), stopwatchFrame);
+}
+
+/** Starts drawing frames, unless they are already running */
+void startFrames(void){
+    if(frame_event == 0){
+        frame_shown = -1;
+        frame_event = queue.call(stopwatchFrame);
+    }
+}
+
+/** Rings when the countdown reaches zero, whatever mode is shown */
+void countdownEnd(void){
+    Busy busy;
+    countdown_event = 0;
+    if(!stopwatch.running())
+        return;
+
+    /** The queue's milliseconds can run a little ahead of the Timer */
+    if(!stopwatch.expired()){
+        countdown_event = queue.call_in(std::chrono::milliseconds(stopwatch.hundredths()*10), countdownEnd);
+        return;
+    }
+
+    stopwatch.stop();
+    ring("TIME UP");
+}
+
+/** Stops the stopwatch and the countdown event */
+void stopTimer(void){
+    stopwatch.stop();
+    queue.cancel(countdown_event);
+    countdown_event = 0;
+}
+
+/**
+ * @brief Acts on a key press in TIMER_MODE.
+ *
+ * 'A' starts and stops, 'M' resets, '#' switches between the
+ * stopwatch and the countdown, and while the countdown is stopped
+ * the digits set its minutes, two at a time.
+ */
+void timerKey(char key){
+    if(key == 'A'){
+        if(stopwatch.running())
+            stopTimer();
+        else if(!stopwatch.expired()){
+            stopwatch.start();
+            if(stopwatch.countdown())
+                countdown_event = queue.call_in(std::chrono::milliseconds(stopwatch.hundredths()*10), countdownEnd);
+            startFrames();
+        }
+    }
+    else if(key == 'M'){
+        stopTimer();
+        stopwatch.reset();
+    }
+    else if(stopwatch.running()){
+        /** The other keys wait until the stopwatch is stopped. */
+    }
+    else if(key == '#'){
+        stopwatch.setCountdown(stopwatch.countdown() ? 0 : countdown_minutes*6000);
+    }
+    else if(key >= '0' && key <= '9' && stopwatch.countdown()){
+        int minutes = countdown_minutes % 10 * 10 + (key - '0');
+        if(minutes > 0){
+            countdown_minutes = minutes;
+            stopwatch.setCountdown(minutes*6000);
+        }
+    }
+}
+
+/**
+ * @brief Prints the hourly temperature for the last day and the
+ * daily temperature for the last week over the serial port.
+ */
+void print_history(void){
+    uint32_t now = time(NULL);
+    uint32_t hour = now - now%3600, day = now - now%86400;
+
+    printf("hour  min  max  mean (0.1 C)\n");
+    for(int i = 23; i >= 0; i--){
+        Rollup r = temp_history.range(HOURS, hour - i*3600, hour - i*3600 + 3600);
+        if(r.count)
+            printf("-%2d %4d %4d %4d\n", i, r.min, r.max, r.mean());
+    }
+
+    printf("day   min  max  mean (0.1 C)\n");
+    for(int i = 6; i >= 0; i--){
+        Rollup r = temp_history.range(DAYS, day - i*86400, day - i*86400 + 86400);
+        if(r.count)
+            printf("-%2d %4d %4d %4d\n", i, r.min, r.max, r.mean());
+    }
+}
+
+/**
+ * @brief Prints the key press latency histograms, the
+ * temperature log and sampling counters, the idle time, the
+ * temperature history, the alarms and the stopwatch frame
+ * counters over the serial port.
+ */
+void print_stats(void){
+    key_latency.print();
+    second_latency.print("second->lcd");
+    printf("second ticks late: %lu\n", (unsigned long)late_seconds);
+    temp_log.printStats();
+    print_sampling();
+    cpu_idle.print("cpu");
+    print_history();
+    print_alarms();
+    printf("stopwatch: %lu frames, %lu hundredths skipped\n",
+           (unsigned long)stopwatch_frames, (unsigned long)stopwatch_skipped);
+}
+
+/**
+ * @brief The serial console. Its receive interrupt puts every byte
+ * into serial_rx for the command parser. printf() writes through
+ * console_output, which queues the bytes for the transmit
+ * interrupt, so even a full REPORT returns without waiting for
+ * the line.
+ */
+const int SERIAL_BAUD = 115200;
+UnbufferedSerial console(USBTX, USBRX, SERIAL_BAUD);
+SerialOutput console_output(console);
+
+namespace mbed {
+FileHandle *mbed_override_console(int){
+    return &console_output;
+}
+}
+
+ByteRing<128> serial_rx;
+CommandParser serial_parser;
+volatile bool serial_posted = false;
+
+/** Bytes parsed per event, so a long burst cannot hold up the display */
+const int SERIAL_BYTES_PER_EVENT = 32;
+
+/**
+ * @brief Ties the shared serial commands to the clock. The command
+ * table and the reply formats are in SerialCommand.cpp.
+ */
+class ClockCommands : public CommandTarget {
+public:
+    virtual void write(const char *text, size_t length){
+        fwrite(text, 1, length, stdout);
+    }
+
+    virtual time_t now(){
+        return time(NULL);
+    }
+
+    virtual void setTime(time_t utc){
+        set_time(utc);
+        unlockSecond();
+        rescheduleAlarms();
+    }
+
+    virtual LocalTime &localTime(){
+        return local_time;
+    }
+
+    virtual void setZone(int zone){
+        local_time.setZone(zone);
+        rescheduleAlarms();
+    }
+
+    virtual TempStatus temp(){
+        TempSample reading = temp_sensors.reading(0);
+        TempStatus status = {reading.tenths_c, reading.count, temp_sensors.errors(0)};
+        return status;
+    }
+
+    virtual bool stats(StatsStatus &stats){
+        if(temp_stats.count() == 0)
+            return false;
+        stats.min = temp_stats.min();
+        stats.max = temp_stats.max();
+        stats.mean = temp_stats.mean();
+        stats.count = temp_stats.count();
+        stats.trend = temp_trend.slope(READINGS_PER_HOUR);
+        return true;
+    }
+
+    virtual PerfStatus perf(){
+        PerfStatus perf = {
+                cpu_idle.idlePermille(),
+                key_latency.total().percentile(99),
+                second_latency.percentile(99),
+                late_seconds,
+                stopwatch_skipped,
+                serial_rx.dropped(),
+                console_output.dropped(),
+        };
+        return perf;
+    }
+
+    virtual void report(){
+        print_stats();
+    }
+};
+
+ClockCommands clock_commands;
+
+void serialTick(void);
+
+/** Console receive interrupt: moves the bytes into serial_rx and posts serialTick() */
+void serialIrq(void){
+    char c;
+    while(console.readable()){
+        console.read(&c, 1);
+        serial_rx.push(c);
+    }
+    if(!serial_posted){
+        serial_posted = true;
+        queue.call(serialTick);
+    }
+}
+
+/**
+ * @brief Feeds received bytes to the command parser and runs each
+ * command as its line ends. At most SERIAL_BYTES_PER_EVENT bytes
+ * are taken per event; the rest wait behind the other events.
+ */
+void serialTick(void){
+    Busy busy;
+    serial_posted = false;
+
+    char c;
+    for(int n = 0; n < SERIAL_BYTES_PER_EVENT; n++){
+        if(!serial_rx.pop(c))
+            return;
+        if(serial_parser.feed(c))
+            runCommand(serial_parser, clock_commands);
+    }
+
+    serial_posted = true;
+    queue.call(serialTick);
+}
+
+
+/** Entry mode ERROR_MODE goes back to */
+int error_from = SET_MODE;
+
+/**
+ * @brief Leaves ERROR_MODE two seconds after it was entered and
+ * goes back to the entry that failed.
+ */
+void leaveError(void){
+    Busy busy;
+    if(mode == ERROR_MODE){
+        mode = error_from;
+        index = 0;
+        update_LCD = 1;
+        render();
+    }
+}
+
+/** Shows the error screen and goes back to the failed entry after two seconds */
+void enterError(void){
+    error_from = mode;
+    mode = ERROR_MODE;
+    queue.call_in(std::chrono::seconds(2), leaveError);
+}
+
+/**
+ * @brief Acts on one key event.
+ *
+ * @param key_event Key and event type from the keypad
+ */
+void handleKey(KeyEvent key_event){
+    char key_map_val = key_event.key;
+
+    /**
+     * This is the conditional entry point for key press entries.
+     *
+     * '?' marks a ghosting pattern on the keypad and is not
+     * used as an entry.
+     *
+     * Key presses are not used to update entries when ERROR_MODE
+     * is active. This prevents bugs/errors in operation.
+     *
+     * SET_MODE is activated by the '*' key. Pressing the '*' key
+     * will also reset the current entries and take the user back
+     * to the HOUR entry menu.
+     *
+     * Pressing the 'D' key at any time returns the user to
+     * NORMAL operation without updating the time.
+     *
+     * Each entry can be checked/entered by pressing the '#' key.
+     * If the entry is incorrect/out of bounds, then ERROR_MODE
+     * will be entered for 2 seconds.
+     *
+     * While entering the hour or minutes, 'A' steps the value up
+     * and 'M' steps it down; holding either key auto-repeats.
+     * Holding '#' on the minutes entry confirms them and then sets
+     * the time right away, keeping the current AM/PM.
+     *
+     * Holding 'D' prints the key press latency histograms over
+     * the serial port.
+     *
+     * In NORMAL_MODE '#' switches the second line between the
+     * temperature statistics and the temperature graph, and 'P'
+     * steps to the next time zone and shows its name on the
+     * second line for a few seconds.
+     *
+     * ALARM_MODE is activated by the 'A' key in NORMAL_MODE. It
+     * takes the hour, minutes and AM/PM like SET_MODE, then the
+     * days per week: 00 rings once, 05 on weekdays and 07 daily.
+     * Entering an alarm that is already set removes it.
+     *
+     * TIMER_MODE is activated by the 'M' key in NORMAL_MODE and
+     * shows the stopwatch; see timerKey() for its keys.
+     *
+     * While an alarm rings, the next key press only silences it.
+     *
+     */
+    if(alarm_ringing){
+        if(key_event.type == KEY_PRESS)
+            silenceAlarm();
+        return;
+    }
+
+    if(key_map_val != '?' && mode != ERROR_MODE){
+        if(key_event.type == KEY_PRESS){
+            key_edge = keypad.pressEdgeUs();
+            key_detect = keypad.pressDetectUs();
+            key_dispatch = us_ticker_read();
+            key_timed = true;
+        }
+
+        /** Stepping keys act on the first press and on every repeat. */
+        if((key_event.type == KEY_PRESS || key_event.type == KEY_REPEAT)
+           && (mode == SET_MODE || mode == ALARM_MODE) && (entry_mode == HOUR || entry_mode == MIN)
+           && (key_map_val == 'A' || key_map_val == 'M')){
+            if(entry_mode == HOUR)
+                step_entry(key_map_val == 'A' ? 1 : -1, 1, 12);
+            else
+                step_entry(key_map_val == 'A' ? 1 : -1, 0, 59);
+            update_LCD = 1;
+        }
+        else if(key_event.type == KEY_LONG_PRESS && mode == SET_MODE && entry_mode == AM_PM
+                && key_map_val == '#'){
+            if(calendar.update(local_time.toLocal(time(NULL))).hour >= 12 && hr != 12)
+                hr = hr + 12;
+            entry_mode = ENTER;
+        }
+        else if(key_event.type == KEY_LONG_PRESS && key_map_val == 'D'){
+            print_stats();
+        }
+        else if(key_event.type != KEY_PRESS){
+            /** Other repeats, long presses and releases are not used. */
+        }
         /**
-         * This is the conditional entry point for key press entries.
-         *
-         * Null characters, 'x' represent no key presses.
-         *
-         * Key presses are not used to update entries when ERROR_MODE
-         * is active. This prevents bugs/errors in operation.
-         *
-         * SET_MODE is activated by the '*' key. Pressing the '*' key
-         * will also reset the current entries and take the user back
-         * to the HOUR entry menu.
-         *
-         * Pressing the 'D' key at any time returns the user to
-         * NORMAL operation without updating the time.
-         *
-         * Each entry can be checked/entered by pressing the '#' key.
-         * If the entry is incorrect/out of bounds, then ERROR_MODE
-         * will be entered for 2 seconds.
-         *
+         * If the '*' key is entered, the program enters SET_MODE and the screen is updated.
+         * If the '*' key is pressed while in SET_MODE the entries are reset and the user is
+         * returned to HOUR entry.
          */
-        if(key_map_val != 'x' && mode != ERROR_MODE){
-            /**
-             * If the '*' key is entered, the program enters SET_MODE and the screen is updated.
-             * If the '*' key is pressed while in SET_MODE the entries are reset and the user is
-             * returned to HOUR entry.
-             */
-            if(key_map_val == '*'){
-                mode = SET_MODE;
-                entry_mode = HOUR;
+        else if(key_map_val == '*'){
+            mode = SET_MODE;
+            entry_mode = HOUR;
+            update_LCD = 1;
+            index = 0; /** Returns user entry to first entry field. */
+            reset_entries();
+        }
+        else if(key_map_val == 'D'){
+            mode = NORMAL_MODE;
+            entry_mode = HOUR;
+            reset_entries();
+        }
+        else if(mode == NORMAL_MODE && key_map_val == '#'){
+            line2_page = line2_page == STATS_PAGE ? SPARK_PAGE : STATS_PAGE;
+            update_LCD = 1;
+        }
+        else if(mode == NORMAL_MODE && key_map_val == 'P'){
+            local_time.setZone((local_time.zoneIndex() + 1) % timeZoneCount());
+            local_time.toLocal(time(NULL));
+            char line[17];
+            snprintf(line, sizeof(line), "%s %s", local_time.zone().name, local_time.abbreviation());
+            showBanner(line);
+
+            /** Alarms keep their local time in the new zone */
+            rescheduleAlarms();
+        }
+        else if(mode == TIMER_MODE){
+            timerKey(key_map_val);
+            update_LCD = 1;
+        }
+        else if(mode == NORMAL_MODE && key_map_val == 'M'){
+            mode = TIMER_MODE;
+            update_LCD = 1;
+            if(stopwatch.running())
+                startFrames();
+        }
+        else if(mode == NORMAL_MODE && key_map_val == 'A'){
+            mode = ALARM_MODE;
+            entry_mode = HOUR;
+            update_LCD = 1;
+            index = 0;
+            reset_entries();
+        }
+        else if(mode == SET_MODE || mode == ALARM_MODE){
+            if(key_map_val != '#'){
+                current_entry[index] = key_map_val;
+                index = index == 0 ? 1 : 0; /** Switches entry index location. */
                 update_LCD = 1;
-                index = 0; /** Returns user entry to first entry field. */
-                reset_entries();
-            }
-            else if(key_map_val == 'D'){
-                mode = NORMAL_MODE;
-                entry_mode = HOUR;
-                reset_entries();
             }
-            else if(mode == SET_MODE){
-                if(key_map_val != '#'){
-                    current_entry[index] = key_map_val;
-                    index = index == 0 ? 1 : 0; /** Switches entry index location. */
-                    update_LCD = 1;
+            else{
+                if(entry_mode == HOUR){
+                    hr = (current_entry[0] - '0')*10 + (current_entry[1] - '0');
+                    if(hr < 1 || hr > 12)
+                        enterError();
+                    else
+                        entry_mode++;
                 }
-                else{
-                    if(entry_mode == HOUR){
-                        hr = (current_entry[0] - '0')*10 + (current_entry[1] - '0');
-                        if(hr < 1 || hr > 12){
-                            timer.reset();
-                            mode = ERROR_MODE;
-                        }
-                        else
-                            entry_mode++;
-                    }
-                    else if(entry_mode == MIN){
-                        min = (current_entry[0] - '0')*10 + (current_entry[1] - '0');
-                        if(min > 59){
-                            timer.reset();
-                            mode = ERROR_MODE;
-                        }
-                        else
-                            entry_mode++;
+                else if(entry_mode == MIN){
+                    mins = (current_entry[0] - '0')*10 + (current_entry[1] - '0');
+                    if(mins > 59)
+                        enterError();
+                    else
+                        entry_mode++;
+                }
+                else if(entry_mode == AM_PM){
+                    if(current_entry[0] != 'A' && current_entry[0] != 'P' || current_entry[1] != 'M')
+                        enterError();
+                    else{
+                        if(current_entry[0] == 'P' && hr != 12)
+                            hr = hr + 12;
+                        entry_mode = mode == ALARM_MODE ? REPEAT : ENTER;
                     }
-                    else if(entry_mode == AM_PM){
-                        if(current_entry[0] != 'A' && current_entry[0] != 'P' || current_entry[1] != 'M'){
-                            timer.reset();
-                            mode = ERROR_MODE;
-                        }
-                        else{
-                            if(current_entry[0] == 'P' && hr != 12)
-                                hr = hr + 12;
-                            entry_mode++;
-                        }
+                }
+                else if(entry_mode == REPEAT){
+                    if(current_entry[0] != '0'
+                       || (current_entry[1] != '0' && current_entry[1] != '5' && current_entry[1] != '7'))
+                        enterError();
+                    else{
+                        alarm_days = current_entry[1] == '0' ? ALARM_ONCE
+                                   : current_entry[1] == '5' ? ALARM_WEEKDAYS : ALARM_DAILY;
+                        entry_mode = ENTER;
                     }
-                    /** This ensures the screen is always updated after a key press. */
-                    update_LCD = 1;
-                    reset_entries();
                 }
+                /** This ensures the screen is always updated after a key press. */
+                update_LCD = 1;
+                reset_entries();
             }
         }
+    }
 
-        /**
-         * TIME UPDATE SECTION
-         *
-         * This section updates the RTC time and resets the mode of operation.
-         *
-         * */
-        if(entry_mode == ENTER){
-            timeinfo->tm_hour = hr; // Hour (24-hour format)
-            timeinfo->tm_min = min; // Minutes
-            timeinfo->tm_sec = 0; // seconds
-            time_t new_time_t = mktime(timeinfo);
-            set_time(new_time_t);
-            mode = NORMAL_MODE; // normal
-            entry_mode = HOUR;
-            reset_entries();
+    /**
+     * TIME UPDATE SECTION
+     *
+     * This section updates the RTC time, or saves the alarm, and
+     * resets the mode of operation.
+     *
+     * */
+    if(entry_mode == ENTER){
+        if(mode == ALARM_MODE)
+            saveAlarm();
+        else{
+            DateTime date = calendar.update(local_time.toLocal(time(NULL)));
+            date.hour = hr; // Hour (24-hour format)
+            date.minute = mins; // Minutes
+            date.second = 0; // seconds
+            calendar.set(date);
+            set_time(local_time.toUtc(calendar.time()));
+            unlockSecond();
+            rescheduleAlarms();
+        }
+        mode = NORMAL_MODE; // normal
+        entry_mode = HOUR;
+        update_LCD = 1;
+        reset_entries();
+    }
+}
+
+/**
+ * @brief SCREEN UPDATE SECTION
+ *
+ * This section updates the LCD Screen.
+ *
+ * It updates once every second for the time display
+ * while in NORMAL MODE. The first line ends with the
+ * temperature, held steady by temp_gate, and an arrow for
+ * its trend. The second line shows the lowest, highest and
+ * average temperature of the last 24 hours and the trend
+ * per hour, or a graph of the last 16 minutes. For a few
+ * seconds after 'P' or a new alarm it shows the time zone or
+ * the alarm instead, and while an alarm rings it shows the
+ * alarm. Both lines
+ * are redrawn in full and the LCD driver only sends the
+ * characters that changed, which on most seconds is just
+ * the seconds digits.
+ *
+ * It updates for each key press while in SET_MODE or
+ * ALARM_MODE; the alarm entry is marked on the second line.
+ *
+ * It updates after 2 seconds in ERROR_MODE.
+ *
+ * In TIMER_MODE it draws the whole stopwatch screen after a key
+ * press; while the stopwatch runs, stopwatchFrame() redraws just
+ * the time.
+ */
+void render(void){
+    if(mode == NORMAL_MODE){
+        if(toggle != shown_toggle){
+            temp_gate.reset();
+            shown_toggle = toggle;
         }
+        if(temp_sensors.reading(0).count)
+            temp_gate.update(getTempTenths(toggle), uptimeMs());
+        int temp = temp_gate.shown();
 
+        const DateTime &now = calendar.update(local_time.toLocal(time(NULL)));
+        int rate = temp_trend.slope(READINGS_PER_HOUR);
+        showTrend(rate);
 
         /**
-         * SCREEN UPDATE SECTION
-         *
-         * This section updates the LCD Screen.
-         *
-         * It updates once every second for the time display
-         * while in NORMAL MODE.
-         *
-         * It updates for each keyp press while in SET_MODE.
-         *
-         * It updates after 2 seconds in ERROR_MODE.
-         *
+         * The temperature gets three columns, at least two digits
+         * right aligned, so a three digit reading such as 100F takes
+         * the space in front of it instead of losing its unit. The
+         * minute and second are already below 60; the % 60 lets gcc
+         * see the line fits without -Wformat-truncation warnings.
          */
+        char line[17];
+        snprintf(line, sizeof(line), "%02d:%02d:%02d %s%3.2d%c",
+                 (now.hour % 12 == 0) ? 12 : now.hour % 12,
+                 now.minute % 60,
+                 now.second % 60,
+                 (now.hour > 12) ? "PM" : "AM",
+                 temp,
+                 C_F[toggle]);
+        lcd.locate(0, 0);
+        lcd.printf("%-15.15s", line);
+        lcd.putc(TREND_GLYPH);
 
-        if((mode == NORMAL_MODE && timer.read_ms() >= 1000)){
-            temp = getTemp(toggle);
-            seconds = time(NULL);
-            tm *timeinfo = localtime(&seconds);
-            lcd.cls();
-            lcd.printf("%02d:%02d:%02d %s %02d %c",
-                       (timeinfo->tm_hour % 12 == 0) ? 12 : timeinfo->tm_hour % 12,
-                       timeinfo->tm_min,
-                       timeinfo->tm_sec,
-                       (timeinfo->tm_hour > 12) ? "PM" : "AM",
-                       temp,
-                       C_F[toggle]);
-            timer.reset();
+        if(alarm_ringing){
+            snprintf(line, sizeof(line), "%s", ring_text);
         }
-        else if(mode >= SET_MODE && update_LCD == 1){
-            lcd.cls();
-            if(mode == ERROR_MODE)
-                lcd.printf("---- ERROR! ----");
-            else if(entry_mode == HOUR)
-                lcd.printf("HOUR:  %c%c", current_entry[0], current_entry[1]);
-            else if(entry_mode == MIN)
-                lcd.printf("MIN:  %c%c", current_entry[0], current_entry[1]);
-            else if(entry_mode == AM_PM)
-                lcd.printf("AM or PM:  %c%c", current_entry[0], current_entry[1]);
-            update_LCD = 0;
+        else if((int32_t)(uptimeMs() - banner_until) < 0){
+            snprintf(line, sizeof(line), "%s", banner);
         }
-        else if(mode == ERROR_MODE && timer.read_ms() >= 2000){
-            timer.reset();
-            mode--;
-            index = 0;
-            update_LCD = 1;
+        else if(line2_page == SPARK_PAGE){
+            /** Only the cells whose bar changed reach the bus */
+            temp_spark.render(line, SPARK_GLYPH);
+            line[16] = '\0';
+        }
+        else{
+            int length = snprintf(line, sizeof(line), "%d/%d/%d",
+                                  toUnit(temp_stats.min(), toggle),
+                                  toUnit(temp_stats.max(), toggle),
+                                  toUnit(temp_stats.mean(), toggle));
+
+            /** The rate goes at the right of the line if it fits */
+            char rate_text[8];
+            if(toggle)
+                rate = rate*9/5;
+            int rate_length = snprintf(rate_text, sizeof(rate_text), "%c%d.%d/h",
+                                       rate < 0 ? '-' : '+', abs(rate)/10, abs(rate)%10);
+            if(length + 1 + rate_length <= 16)
+                snprintf(line + length, sizeof(line) - length, "%*s", 16 - length, rate_text);
+        }
+        lcd.locate(0, 1);
+        lcd.printf("%-16.16s", line);
+        update_LCD = 0;
+    }
+    else if(mode == TIMER_MODE){
+        char line[17], text[9];
+        if(alarm_ringing)
+            snprintf(line, sizeof(line), "%s", ring_text);
+        else
+            snprintf(line, sizeof(line), "%-12s%4s",
+                     stopwatch.countdown() ? "COUNTDOWN" : "STOPWATCH",
+                     stopwatch.running() ? "RUN" : "STOP");
+        lcd.locate(0, 0);
+        lcd.printf("%-16.16s", line);
+
+        Stopwatch::format(stopwatch.hundredths(), text);
+        snprintf(line, sizeof(line), "%*s%s", STOPWATCH_COLUMN, "", text);
+        lcd.locate(0, 1);
+        lcd.printf("%-16.16s", line);
+        update_LCD = 0;
+    }
+    else if(mode >= SET_MODE && update_LCD == 1){
+        uint32_t render_start = us_ticker_read();
+        lcd.cls();
+        if(mode == ERROR_MODE)
+            lcd.printf("---- ERROR! ----");
+        else if(entry_mode == HOUR)
+            lcd.printf("HOUR:  %c%c", current_entry[0], current_entry[1]);
+        else if(entry_mode == MIN)
+            lcd.printf("MIN:  %c%c", current_entry[0], current_entry[1]);
+        else if(entry_mode == AM_PM)
+            lcd.printf("AM or PM:  %c%c", current_entry[0], current_entry[1]);
+        else if(entry_mode == REPEAT)
+            lcd.printf("DAYS/WEEK:  %c%c", current_entry[0], current_entry[1]);
+        if(mode == ALARM_MODE){
+            lcd.locate(0, 1);
+            lcd.printf("%s", entry_mode == REPEAT ? "ALARM 00, 05, 07" : "ALARM");
+        }
+        update_LCD = 0;
+
+        if(key_timed)
+            record_key_latency(key_edge, key_detect, key_dispatch, render_start);
+    }
+}
+
+/** Redraws the screen at once, e.g. after the unit changed */
+void redraw(void){
+    Busy busy;
+    update_LCD = 1;
+    render();
+}
+
+/** The second tick is posted this long before the RTC's next second */
+const int EDGE_GUARD_MS = 3;
+
+/** Longest the second tick waits for the edge before it gives up */
+const uint32_t EDGE_WAIT_US = 2000 * EDGE_GUARD_MS;
+
+/**
+ * @brief Runs on every RTC second: redraws the clock, then feeds
+ * the temperature statistics.
+ *
+ * The RTC has no portable second interrupt, so the tick locks on
+ * to the edge itself. Once locked it is posted EDGE_GUARD_MS before
+ * the next edge and spins on time() until the second changes, so
+ * the redraw starts within microseconds of the edge and the shown
+ * seconds never skip or repeat. The edge is measured again every
+ * second, so drift between the RTC and the us ticker cannot build
+ * up.
+ *
+ * Without a lock the tick checks time() once a millisecond until
+ * it sees an edge, and then locks. The lock is dropped when the
+ * spin finds no edge, when a tick runs after the edge because
+ * other events held it up, and by unlockSecond() when the time is
+ * set. A late tick redraws at once and is counted in late_seconds;
+ * if it is exactly one second behind, the next poll starts just
+ * before the edge it expects, otherwise at once.
+ *
+ * Every redraw is added to second_latency, timed from the edge.
+ */
+void secondTick(void){
+    Busy busy;
+    static time_t shown = 0;
+    static bool polling = false;
+
+    uint32_t start = us_ticker_read();
+    time_t now = time(NULL);
+    bool before = now == shown;
+    while(second_locked && now == shown && us_ticker_read() - start < EDGE_WAIT_US)
+        now = time(NULL);
+
+    if(now == shown){
+        second_locked = false;
+        polling = true;
+        queue.call_in(std::chrono::milliseconds(1), secondTick);
+        return;
+    }
+
+    /** The edge is known to a millisecond if the old second was seen just before it */
+    uint32_t edge = us_ticker_read();
+    bool found = before || polling;
+    bool estimated = false;
+    polling = false;
+
+    if(!found && second_locked){
+        late_seconds++;
+        if(now - shown == 1){
+            /** The RTC ticks once a second, so the edge came a second after the last one */
+            edge = second_edge + 1000000;
+            estimated = true;
         }
     }
+    second_locked = found;
+    shown = now;
+    second_edge = edge;
+
+    if(mode == NORMAL_MODE){
+        render();
+        second_latency.add(lcd.lastWrite() - edge);
+    }
+    updateTempStats(now);
+
+    int wait_ms = 1;
+    if(found || estimated){
+        wait_ms = 1000 - EDGE_GUARD_MS - (int)((us_ticker_read() - edge) / 1000);
+        if(wait_ms < 1)
+            wait_ms = 1;
+    }
+    queue.call_in(std::chrono::milliseconds(wait_ms), secondTick);
+}
+
+void keypadTick(void){
+    Busy busy;
+    keypad.update(uptimeMs());
+
+    KeyEvent key_event;
+    while(keypad.get(key_event)){
+        handleKey(key_event);
+        if(update_LCD == 1)
+            render();
+    }
+
+    /** Only key presses that reached the screen in this pass are timed */
+    key_timed = false;
+
+    /** Keep scanning until the keypad is idle; the next press posts keypadWake() again */
+    if(keypad.idle())
+        keypad_scanning = false;
+    else
+        queue.call_in(std::chrono::milliseconds(SCAN_PERIOD_MS), keypadTick);
+}
+
 
+/**
+ * @brief Program entry point.
+ *
+ * The program is organized as follows:
+ *      1 - SET UP
+ *          - This initializes all variables and
+ *            sets the GPIO settings for keypad
+ *      2 - OPERATION
+ *          - Events run from the event queue:
+ *            keypad scans while a key is down,
+ *            sensor polling, the once a second
+ *            clock tick and button presses
+ *          - The core sleeps between events
+ *
+ * @return 0, This will never be returned.
+ */
+int main()
+{
+    /** SET UP SECTION */
+
+    /** This is called in start up to initialize the blank characters */
+    reset_entries();
+
+    /**
+     * Use the calibration stored in flash if there is one, then start
+     * background sampling of the analog sensor and schedule the sensor
+     */
+    temp_table.loadCalibration();
+#if !TEMP_SENSOR_DS18B20 && !TEMP_SENSOR_TMP1XX
+    temp_sensor.setAdaptive(SAMPLE_FAST_MS, SAMPLE_SLOW_MS, SAMPLE_THRESHOLD, SAMPLE_BUDGET);
+    temp_sensor.start();
+#endif
+    temp_sensors.add(temp_probe);
+
+    /** Resume the temperature log where it left off before the reset */
+    temp_log.init();
+
+    uptime.start();
+    shown_toggle = toggle;
+
+    /** The graph's bar glyphs never change, so they are loaded once */
+    for(int height = 1; height <= SPARK_GLYPHS; height++){
+        char pattern[8];
+        Sparkline<16>::barPattern(height, pattern);
+        lcd.setUDC(SPARK_GLYPH + height - 1, pattern);
+    }
+
+    /** Interrupts post their work to the queue */
+    button.fall(temp_toggle);
+    keypad.attach(keypadIrq);
+    console.attach(serialIrq, SerialBase::RxIrq);
+
+    /** OPERATION SECTION */
+    queue.call_every(std::chrono::milliseconds(SENSOR_POLL_MS), sensorTick);
+    queue.call(secondTick);
+    queue.call(keypadWake);
+    queue.dispatch_forever();
 
     return 0;
 }
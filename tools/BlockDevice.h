@@ -0,0 +1,37 @@
+/**
+ * @file BlockDevice.h
+ *
+ * @brief Host stand-in for mbed's BlockDevice interface, so the
+ * flash code can be built and checked off the board.
+ *
+ * Only the calls TempLog makes are declared, with mbed's
+ * signatures. Put this directory first on the include path:
+ *
+ *   g++ -I. -I.. ...
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef TOOLS_BLOCKDEVICE_H
+#define TOOLS_BLOCKDEVICE_H
+
+#include <stdint.h>
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+/** The subset of mbed::BlockDevice used by TempLog */
+class BlockDevice {
+public:
+    virtual ~BlockDevice() {}
+
+    virtual int init() = 0;
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+    virtual int erase(bd_addr_t addr, bd_size_t size) = 0;
+    virtual bd_size_t get_erase_size() const = 0;
+    virtual bd_size_t size() const = 0;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file calendar_bench.cpp
+ *
+ * @brief Host check and benchmark of Calendar against the C
+ * library's gmtime_r(), timegm() and mktime().
+ *
+ * Build and run on a host computer:
+ *
+ *   g++ -O2 -I.. -o calendar_bench calendar_bench.cpp ../Calendar.cpp
+ *   ./calendar_bench [first_year last_year]
+ *
+ * The sweep converts a time every 997 seconds, a prime stride that
+ * lands on every second, minute and hour of the day, from the first
+ * to the last year given (1874 to 2223 by default). Each result
+ * must match gmtime_r() field for field and convert back to the
+ * same time. Calendar::update() is then stepped one second at a
+ * time through a leap year and checked against dateTimeFromTime().
+ *
+ * The timings are host nanoseconds per call. They compare the two
+ * approaches on the same machine; they are not board figures.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Calendar.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Keeps the optimiser from dropping the timed work */
+static volatile long sink;
+
+static bool sameAsLibc(const DateTime &date, const struct tm &utc) {
+    return date.year == utc.tm_year + 1900 && date.month == utc.tm_mon + 1 && date.day == utc.tm_mday &&
+           date.hour == utc.tm_hour && date.minute == utc.tm_min && date.second == utc.tm_sec &&
+           date.weekday == utc.tm_wday;
+}
+
+/** @return mismatches between dateTimeFromTime(), timeFromDateTime() and gmtime_r() */
+static long sweep(int first_year, int last_year) {
+    time_t start = timeFromDateTime(DateTime{int16_t(first_year), 1, 1, 0, 0, 0, 0});
+    time_t end = timeFromDateTime(DateTime{int16_t(last_year + 1), 1, 1, 0, 0, 0, 0});
+    long checked = 0, bad = 0;
+    for (time_t t = start; t < end; t += 997) {
+        struct tm utc;
+        DateTime date;
+        gmtime_r(&t, &utc);
+        dateTimeFromTime(t, date);
+        if (!sameAsLibc(date, utc) || timeFromDateTime(date) != t) {
+            if (bad++ < 5)
+                printf("      mismatch at %lld\n", (long long)t);
+        }
+        checked++;
+    }
+    printf("sweep           %d-%d, %ld times, %ld mismatches\n", first_year, last_year, checked, bad);
+    return bad;
+}
+
+/** @return mismatches of Calendar::update() stepping through a leap year */
+static long stepping() {
+    time_t start = timeFromDateTime(DateTime{2023, 12, 31, 23, 59, 50, 0});
+    time_t end = start + 367*SECONDS_PER_DAY;
+    Calendar calendar(start);
+    long bad = 0;
+    for (time_t t = start; t < end; t++) {
+        DateTime expected;
+        dateTimeFromTime(t, expected);
+        const DateTime &date = calendar.update(t);
+        if (date.year != expected.year || date.month != expected.month || date.day != expected.day ||
+            date.hour != expected.hour || date.minute != expected.minute || date.second != expected.second ||
+            date.weekday != expected.weekday)
+            bad++;
+    }
+    printf("stepping        2023-12-31 to 2025-01-01, %ld mismatches\n", bad);
+    return bad;
+}
+
+template<typename F>
+static double nanoseconds(long count, F f) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < count; i++)
+        f(i);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+}
+
+static void benchmark() {
+    const long COUNT = 10000000;
+    const time_t BASE = 1700000000;
+
+    /** mktime() is timed in UTC so it does the same work as timegm() plus the zone lookup */
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    Calendar calendar(BASE);
+    printf("update +1 s     %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        sink = calendar.update(BASE + i).second;
+    }));
+    printf("gmtime_r +1 s   %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        time_t t = BASE + i;
+        struct tm utc;
+        gmtime_r(&t, &utc);
+        sink = utc.tm_sec;
+    }));
+
+    /** A jump that update() converts in full, as after the clock is set */
+    printf("update jump     %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        sink = calendar.update(BASE + i*7919).second;
+    }));
+    printf("dateTimeFrom    %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        DateTime date;
+        dateTimeFromTime(BASE + i*7919, date);
+        sink = date.second;
+    }));
+
+    /** The setters go the other way, from a date to a time */
+    printf("timeFromDate    %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        DateTime date = {int16_t(1970 + i % 400), uint8_t(1 + i % 12), uint8_t(1 + i % 28), uint8_t(i % 24),
+                         uint8_t(i % 60), uint8_t(i % 60), 0};
+        sink = timeFromDateTime(date);
+    }));
+    printf("Calendar::set   %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        DateTime date = {int16_t(1970 + i % 400), uint8_t(1 + i % 12), uint8_t(1 + i % 28), uint8_t(i % 24),
+                         uint8_t(i % 60), uint8_t(i % 60), 0};
+        calendar.set(date);
+        sink = calendar.time();
+    }));
+    printf("timegm          %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        struct tm utc = {};
+        utc.tm_year = 70 + i % 400;
+        utc.tm_mon = i % 12;
+        utc.tm_mday = 1 + i % 28;
+        utc.tm_hour = i % 24;
+        utc.tm_min = utc.tm_sec = i % 60;
+        sink = timegm(&utc);
+    }));
+    printf("mktime          %6.1f ns\n", nanoseconds(COUNT, [&](long i) {
+        struct tm utc = {};
+        utc.tm_year = 70 + i % 400;
+        utc.tm_mon = i % 12;
+        utc.tm_mday = 1 + i % 28;
+        utc.tm_hour = i % 24;
+        utc.tm_min = utc.tm_sec = i % 60;
+        sink = mktime(&utc);
+    }));
+}
+
+int main(int argc, char **argv) {
+    int first_year = argc == 3 ? atoi(argv[1]) : 1874;
+    int last_year = argc == 3 ? atoi(argv[2]) : 2223;
+    if (argc != 1 && argc != 3) {
+        fprintf(stderr, "usage: %s [first_year last_year]\n", argv[0]);
+        return 2;
+    }
+
+    long bad = sweep(first_year, last_year) + stepping();
+    benchmark();
+    return bad != 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file duty_sim.cpp
+ *
+ * @brief Host simulation of the CPU duty cycle of the old polling
+ * loop and of the event queue, fed through the real IdleMeter.
+ *
+ * Build and run on a host computer:
+ *
+ *   g++ -O2 -I.. -o duty_sim duty_sim.cpp ../Latency.cpp
+ *   ./duty_sim
+ *
+ * Each scenario lists the handlers and interrupts that run, how
+ * often and for how long. The handlers go through IdleMeter on a
+ * simulated microsecond clock, exactly as Busy does on the board,
+ * so the "meter" column is what PERF's idle= would show. Interrupt
+ * time is kept apart: the meter only sees it when an interrupt
+ * lands inside a handler. The "busy" column counts all of it, and
+ * the last column is the interrupt time the meter missed.
+ *
+ * The costs below are estimates from the timing budget, not board
+ * measurements. Change them to measured figures to redo the table.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Latency.h"
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+/** Estimated costs, in microseconds */
+static const uint32_t LCD_BYTE_US = 45;         /**< one TextLCD byte, 4-bit bus plus settle */
+static const uint32_t EDGE_SPIN_US = 3000;      /**< secondTick spinning on time(), EDGE_GUARD_MS */
+static const uint32_t SENSOR_TICK_US = 20;      /**< sensorTick with the analog sensor */
+static const uint32_t ADC_READ_US = 3;          /**< one analogin_read_u16() */
+static const uint32_t OVERSAMPLE = 64;          /**< ADC reads per TempAcquisition sample */
+static const uint32_t KEY_SCAN_US = 80;         /**< keypadTick: three settle periods and the debouncer */
+
+/** A handler or interrupt that runs every period_us */
+struct Activity {
+    const char *name;
+    uint32_t period_us;
+    uint32_t cost_us;
+    bool interrupt;
+};
+
+struct Run {
+    uint32_t start_us;
+    uint32_t cost_us;
+    bool interrupt;
+
+    bool operator<(const Run &other) const {
+        return start_us < other.start_us;
+    }
+};
+
+struct Result {
+    int meter_permille;
+    double true_busy_percent;
+    double hidden_isr_percent;
+};
+
+/**
+ * @brief Runs every activity for the given time on one core.
+ *
+ * Handlers run one at a time, in order, like the EventQueue runs
+ * them. An interrupt runs at once; inside a handler it makes that
+ * handler longer, outside it is time the meter counts as idle.
+ */
+static Result simulate(const std::vector<Activity> &activities, uint32_t seconds) {
+    const uint32_t end_us = seconds * 1000000;
+    std::vector<Run> runs;
+    for (size_t i = 0; i < activities.size(); i++) {
+        const Activity &activity = activities[i];
+        /** Spread the phases over the period so activities do not line up */
+        uint32_t first = uint64_t(activity.period_us) * (i * 37 % 100) / 100;
+        for (uint32_t t = first; t < end_us; t += activity.period_us)
+            runs.push_back(Run{t, activity.cost_us, activity.interrupt});
+    }
+    std::sort(runs.begin(), runs.end());
+
+    IdleMeter meter;
+    meter.begin(0);
+    meter.end(0);
+
+    uint64_t busy_us = 0, hidden_us = 0;
+    uint32_t handler_end = 0;
+    for (size_t i = 0; i < runs.size(); i++) {
+        const Run &run = runs[i];
+        busy_us += run.cost_us;
+        if (run.interrupt) {
+            if (run.start_us < handler_end)
+                handler_end += run.cost_us;
+            else
+                hidden_us += run.cost_us;
+            continue;
+        }
+        uint32_t start = std::max(run.start_us, handler_end);
+        if (handler_end > 0)
+            meter.end(handler_end);
+        meter.begin(start);
+        handler_end = start + run.cost_us;
+    }
+    meter.end(handler_end);
+    /** The meter adds the idle gap up to the end of the run at the next begin() */
+    meter.begin(std::max(end_us, handler_end));
+    meter.end(std::max(end_us, handler_end));
+
+    Result result;
+    result.meter_permille = meter.idlePermille();
+    result.true_busy_percent = 100.0 * busy_us / end_us;
+    result.hidden_isr_percent = 100.0 * hidden_us / end_us;
+    return result;
+}
+
+static void print(const char *scenario, const Result &result) {
+    printf("%-30s  idle=%4d  %6.2f%%  %6.3f%%\n", scenario, result.meter_permille,
+           result.true_busy_percent, result.hidden_isr_percent);
+}
+
+int main() {
+    const uint32_t SECONDS = 600;
+
+    printf("%-30s  %-9s  %-7s  %s\n", "scenario", "meter", "busy", "ISR not in meter");
+
+    /** The polling loop ran one handler that never returned */
+    std::vector<Activity> polling = {
+            {"loop", SECONDS * 1000000, SECONDS * 1000000, false},
+    };
+    print("old polling loop", simulate(polling, SECONDS));
+
+    /** An idle clock on the normal screen, temperature steady */
+    std::vector<Activity> idle = {
+            {"secondTick", 1000000, EDGE_SPIN_US + 3*LCD_BYTE_US, false},
+            {"sensorTick", 100000, SENSOR_TICK_US, false},
+            {"ADC sample", 1000000, OVERSAMPLE*ADC_READ_US, true},
+    };
+    print("events, normal screen", simulate(idle, SECONDS));
+
+    /** Samples every 100 ms while the temperature moves */
+    std::vector<Activity> moving = idle;
+    moving[2].period_us = 100000;
+    print("events, temperature moving", simulate(moving, SECONDS));
+
+    /** A held key: a scan every 5 ms and a repeat redraw every 80 ms */
+    std::vector<Activity> key = idle;
+    key.push_back({"keypadTick", 5000, KEY_SCAN_US, false});
+    key.push_back({"repeat", 80000, 4*LCD_BYTE_US, false});
+    print("events, key held", simulate(key, SECONDS));
+
+    /** The stopwatch redraws its hundredths every 10 ms */
+    std::vector<Activity> stopwatch = idle;
+    stopwatch[0].cost_us = EDGE_SPIN_US;
+    stopwatch.push_back({"stopwatchFrame", 10000, 3*LCD_BYTE_US, false});
+    print("events, stopwatch running", simulate(stopwatch, SECONDS));
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file latency_report.cpp
+ *
+ * @brief Host tool that feeds recorded key press and second edge
+ * timestamps into the clock's latency histograms and prints the
+ * same report as its REPORT command.
+ *
+ * Build and use on a host computer:
+ *
+ *   g++ -O2 -I.. -o latency_report latency_report.cpp ../Latency.cpp
+ *   ./latency_report capture.csv
+ *
+ * Each line of the capture is one event, times in microseconds
+ * from any free-running 32-bit clock, e.g. a logic analyser on the
+ * keypad column and the LCD's E line:
+ *
+ *   key,<edge>,<detect>,<dispatch>,<render>,<done>
+ *   second,<edge>,<done>
+ *
+ * edge is the column edge or RTC second, detect the debounced
+ * press, dispatch the state machine handling it, render the start
+ * of the LCD redraw and done the last byte on the LCD bus. Blank
+ * lines and lines starting with # are skipped. With no file the
+ * capture is read from stdin.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "Latency.h"
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+    FILE *file = stdin;
+    if (argc == 2) {
+        file = fopen(argv[1], "r");
+        if (!file) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    else if (argc > 2) {
+        fprintf(stderr, "usage: %s [capture.csv]\n", argv[0]);
+        return 2;
+    }
+
+    KeyPathLatency key_latency;
+    LatencyHistogram second_latency;
+
+    char line[256];
+    int number = 0, bad = 0;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+
+        unsigned long edge, detect, dispatch, render, done;
+        if (sscanf(line, "key,%lu,%lu,%lu,%lu,%lu", &edge, &detect, &dispatch, &render, &done) == 5)
+            key_latency.add(edge, detect, dispatch, render, done);
+        else if (sscanf(line, "second,%lu,%lu", &edge, &done) == 2)
+            second_latency.add(uint32_t(done) - uint32_t(edge));
+        else {
+            fprintf(stderr, "line %d: not a key or second event\n", number);
+            bad++;
+        }
+    }
+    if (file != stdin)
+        fclose(file);
+
+    /** The latency part of print_stats(), line for line */
+    key_latency.print();
+    second_latency.print("second->lcd");
+    return bad != 0;
+}
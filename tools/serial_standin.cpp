@@ -0,0 +1,149 @@
+/**
+ * @file serial_standin.cpp
+ *
+ * @brief Host stand-in for the clock's serial command interface,
+ * served on a pseudo terminal.
+ *
+ * It runs the device's CommandParser and command table from
+ * SerialCommand.cpp, with the same time zones and calendar, so a
+ * provisioning script can be tested on Linux without a board:
+ *
+ *   g++ -O2 -I.. -o serial_standin serial_standin.cpp \
+ *       ../SerialCommand.cpp ../TimeZone.cpp ../Calendar.cpp
+ *   ./serial_standin /tmp/lcd_clock &
+ *   printf 'TIME 1700000000\n' > /tmp/lcd_clock
+ *
+ * The pty is put in raw mode like a UART. Its path is printed, and
+ * also linked to the path given on the command line. The clock is
+ * the host's clock plus whatever offset TIME has set. Readings and
+ * counters that need the hardware are fixed stand-in values, and
+ * STATS answers "STATS none" like a device with no history yet.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "SerialCommand.h"
+#include "TimeZone.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Master side of the pty; replies are written here */
+static int master = -1;
+
+/** Stand-in reading, tenths of a degree C */
+static const int STANDIN_TENTHS_C = 215;
+
+/**
+ * @brief Answers the shared commands from the host's clock. TIME
+ * keeps an offset from it; readings and counters that need the
+ * hardware are fixed stand-in values.
+ */
+class StandinCommands : public CommandTarget {
+public:
+    StandinCommands() : _offset(0), _started(time(NULL)), _local_time(0) {}
+
+    virtual void write(const char *text, size_t length) {
+        if (::write(master, text, length) < 0)
+            perror("write");
+    }
+
+    virtual time_t now() {
+        return time(NULL) + _offset;
+    }
+
+    virtual void setTime(time_t utc) {
+        _offset = utc - time(NULL);
+    }
+
+    virtual LocalTime &localTime() {
+        return _local_time;
+    }
+
+    virtual void setZone(int zone) {
+        _local_time.setZone(zone);
+    }
+
+    /** A fixed reading, one read per second since the stand-in started */
+    virtual TempStatus temp() {
+        TempStatus status = {STANDIN_TENTHS_C, uint32_t(time(NULL) - _started), 0};
+        return status;
+    }
+
+    /** No history is kept, as on a device that has just started */
+    virtual bool stats(StatsStatus &) {
+        return false;
+    }
+
+    /** An idle unit with nothing late or dropped */
+    virtual PerfStatus perf() {
+        PerfStatus perf = {1000, 0, 0, 0, 0, 0, 0};
+        return perf;
+    }
+
+    /** The device's report needs its histograms; only the closing OK is real */
+    virtual void report() {
+        const char text[] = "report: not kept by the stand-in\n";
+        write(text, sizeof(text) - 1);
+    }
+
+private:
+    int64_t _offset;
+    time_t _started;
+    LocalTime _local_time;
+};
+
+int main(int argc, char **argv) {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    const char *path = ptsname(master);
+
+    /**
+     * Keep the slave side open so reads do not fail between clients,
+     * and make it raw: no echo, no line editing, no CR/LF mapping.
+     */
+    int slave = open(path, O_RDWR | O_NOCTTY);
+    struct termios attributes;
+    if (slave < 0 || tcgetattr(slave, &attributes) != 0) {
+        perror(path);
+        return 1;
+    }
+    cfmakeraw(&attributes);
+    tcsetattr(slave, TCSANOW, &attributes);
+
+    if (argc > 1) {
+        unlink(argv[1]);
+        if (symlink(path, argv[1]) != 0) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    printf("%s\n", path);
+    fflush(stdout);
+
+    /** Bytes go through the parser one at a time, as from the RX ring */
+    StandinCommands target;
+    CommandParser parser;
+    char buffer[64];
+    ssize_t n;
+    while ((n = read(master, buffer, sizeof(buffer))) > 0)
+        for (ssize_t i = 0; i < n; i++)
+            if (parser.feed(buffer[i]))
+                runCommand(parser, target);
+
+    close(slave);
+    if (argc > 1)
+        unlink(argv[1]);
+    return 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * @file serialcommand_check.cpp
+ *
+ * @brief Host check of the serial command protocol: the parser,
+ * the receive ring, the shared command table and the transmit
+ * queue against a mock UART.
+ *
+ * Build and run on a host computer:
+ *
+ *   g++ -O2 -I.. -o serialcommand_check serialcommand_check.cpp \
+ *       ../SerialCommand.cpp ../TimeZone.cpp ../Calendar.cpp
+ *   ./serialcommand_check
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "SerialCommand.h"
+#include "TimeZone.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s  %s\n", ok ? "pass" : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/** Feeds text and collects each finished line's words, "|" between words, ";" after lines */
+static std::string parse(CommandParser &parser, const char *text) {
+    std::string lines;
+    for (; *text; text++) {
+        if (!parser.feed(*text))
+            continue;
+        if (parser.overflowed())
+            lines += "<overflow>";
+        for (int i = 0; i < parser.argc(); i++)
+            lines += std::string(i ? "|" : "") + parser.argv()[i];
+        lines += ";";
+    }
+    return lines;
+}
+
+static void checkParser() {
+    printf("CommandParser\n");
+    CommandParser parser;
+    check(parse(parser, "TIME 123\n") == "TIME|123;", "a line splits into words");
+    check(parse(parser, "  ZONE \t 4  \r\n") == "ZONE|4;", "spaces, tabs and CRLF are stripped");
+    check(parse(parser, "\n\r\n\n") == "", "empty lines are skipped");
+    check(parse(parser, "TE") == "" && parse(parser, "MP\r") == "TEMP;", "a line can arrive in pieces");
+    check(parse(parser, "a b c d e f g h\n") == "a|b|c|d|e|f g h;", "extra words stay in the last one");
+
+    std::string long_line(CommandParser::MAX_LINE + 10, 'x');
+    check(parse(parser, (long_line + "\nHELP\n").c_str()) == "<overflow>;HELP;",
+          "a line that is too long is reported and the next one still parses");
+    std::string exact(CommandParser::MAX_LINE, 'y');
+    check(parse(parser, (exact + "\n").c_str()) == exact + ";", "a line of exactly MAX_LINE fits");
+
+    int64_t value;
+    check(parseNumber("1700000000", value) && value == 1700000000, "parseNumber reads a time");
+    check(parseNumber("-42", value) && value == -42 && parseNumber("+7", value) && value == 7, "signs are read");
+    check(!parseNumber("", value) && !parseNumber("-", value) && !parseNumber("12a", value)
+          && !parseNumber("99999999999999", value), "empty, partial, non-digit and huge words are refused");
+
+    static const Command table[] = {
+            {"TIME", 0, 1, "TIME [seconds]", NULL},
+            {"ZONE", 0, 1, "ZONE [index]", NULL},
+    };
+    check(findCommand(table, 2, "zone") == &table[1] && findCommand(table, 2, "TiMe") == &table[0],
+          "findCommand is case blind");
+    check(findCommand(table, 2, "ZON") == NULL && findCommand(table, 2, "ZONES") == NULL,
+          "findCommand needs the whole name");
+}
+
+static void checkRing() {
+    printf("ByteRing\n");
+    ByteRing<8> ring;
+    int pushed = 0;
+    for (int i = 0; i < 10; i++)
+        pushed += ring.push(char('a' + i));
+    check(pushed == 7 && ring.dropped() == 3, "a ring of 8 holds 7 bytes and counts the rest as dropped");
+    std::string out;
+    char c;
+    while (ring.pop(c))
+        out += c;
+    check(out == "abcdefg", "bytes come out in order");
+}
+
+/** Replies collected by a target with fixed readings */
+class MockTarget : public CommandTarget {
+public:
+    std::string output;
+    time_t clock;
+    int time_sets, zone_sets;
+    bool have_stats;
+    LocalTime local_time;
+
+    MockTarget() : clock(1700000000), time_sets(0), zone_sets(0), have_stats(false), local_time(0) {}
+
+    virtual void write(const char *text, size_t length) {
+        output.append(text, length);
+    }
+
+    virtual time_t now() {
+        return clock;
+    }
+
+    virtual void setTime(time_t utc) {
+        clock = utc;
+        time_sets++;
+    }
+
+    virtual LocalTime &localTime() {
+        return local_time;
+    }
+
+    virtual void setZone(int zone) {
+        local_time.setZone(zone);
+        zone_sets++;
+    }
+
+    virtual TempStatus temp() {
+        TempStatus status = {-15, 42, 3};
+        return status;
+    }
+
+    virtual bool stats(StatsStatus &stats) {
+        StatsStatus fixed = {180, 230, 204, 1440, -3};
+        stats = fixed;
+        return have_stats;
+    }
+
+    virtual PerfStatus perf() {
+        PerfStatus perf = {987, 450, 260, 2, 5, 0, 17};
+        return perf;
+    }
+
+    virtual void report() {
+        output += "report\n";
+    }
+};
+
+/** Runs each line of a script and returns everything the target was sent */
+static std::string run(MockTarget &target, const char *script) {
+    CommandParser parser;
+    target.output.clear();
+    for (; *script; script++)
+        if (parser.feed(*script))
+            runCommand(parser, target);
+    return target.output;
+}
+
+static void checkCommands() {
+    printf("Command table\n");
+    MockTarget target;
+
+    check(run(target, "TIME\n") == "TIME 1700000000 2023-11-14 22:13:20 UTC\n", "TIME prints the clock in the zone");
+    check(run(target, "time 1710000000\n") == "OK\n" && target.clock == 1710000000 && target.time_sets == 1,
+          "TIME sets the clock");
+    check(run(target, "TIME -5\nTIME soon\n") == "ERR bad time\nERR bad time\n" && target.time_sets == 1,
+          "TIME refuses negative and non-numeric times");
+    check(run(target, "TIME 1 2\n") == "ERR usage: TIME [seconds]\n", "too many words print the usage");
+
+    char last_zone[16];
+    snprintf(last_zone, sizeof(last_zone), "ZONE %d\n", timeZoneCount());
+    check(run(target, last_zone) == "ERR bad zone\n" && run(target, "ZONE -1\n") == "ERR bad zone\n"
+          && target.zone_sets == 0, "ZONE refuses indexes outside the table");
+    check(run(target, "ZONE 1\n") == "OK\n" && target.zone_sets == 1, "ZONE selects a zone");
+    std::string zone = run(target, "ZONE\n");
+    std::string expected = std::string("ZONE 1 ") + timeZone(1).name + "\n";
+    check(zone == expected, "ZONE prints the index and name");
+
+    check(run(target, "TEMP\n") == "TEMP -15 42 3\n", "TEMP prints tenths, readings and errors");
+    check(run(target, "STATS\n") == "STATS none\n", "STATS with no readings prints none");
+    target.have_stats = true;
+    check(run(target, "STATS\n") == "STATS 180 230 204 1440 -3\n", "STATS prints low, high, mean, count and trend");
+    check(run(target, "PERF\n") ==
+          "PERF idle=987 key_p99=450 second_p99=260 late=2 skipped=5 rx_dropped=0 tx_dropped=17\n",
+          "PERF prints every counter");
+    check(run(target, "REPORT\n") == "report\nOK\n", "REPORT ends with OK");
+    check(run(target, "HELP\n") == "TIME [seconds]\nZONE [index]\nTEMP\nSTATS\nPERF\nREPORT\nHELP\nOK\n",
+          "HELP lists every command");
+    check(run(target, "NOPE\n\n   \n") == "ERR unknown command\n", "unknown names are refused, blank lines ignored");
+    check(run(target, (std::string(80, 'x') + "\nTEMP\n").c_str()) == "ERR line too long\nTEMP -15 42 3\n",
+          "a long line is refused and the next one runs");
+}
+
+/** UART with a transmit FIFO of a few bytes and an interrupt that can be attached */
+struct MockUart {
+    std::string sent;
+    int room;
+    bool attached;
+    int attaches;
+
+    MockUart() : room(0), attached(false), attaches(0) {}
+};
+
+/** What TxQueue sees of the mock UART */
+struct MockPort {
+    MockUart *uart;
+
+    bool writeable() {
+        return uart->room > 0;
+    }
+
+    void send(char c) {
+        uart->sent += c;
+        uart->room--;
+    }
+
+    void enable(bool on) {
+        if (on && !uart->attached)
+            uart->attaches++;
+        uart->attached = on;
+    }
+};
+
+/** Stands in for CriticalSectionLock; the check has no interrupts to hold off */
+struct NoLock {
+    NoLock() {}
+};
+
+typedef TxQueue<256, MockPort, NoLock> MockTxQueue;
+
+/** The line takes a few bytes and raises the transmit interrupt while it is attached */
+static void drain(MockUart &uart, MockTxQueue &queue, int interrupts) {
+    for (int i = 0; i < interrupts && uart.attached; i++) {
+        uart.room = 4;
+        queue.irq();
+    }
+}
+
+static void checkTxQueue() {
+    printf("TxQueue on a mock UART\n");
+    MockUart uart;
+    MockPort port = {&uart};
+    MockTxQueue queue(port);
+
+    queue.write("OK\n", 3);
+    check(uart.attached && queue.sending() && uart.sent.empty(), "write() attaches the interrupt and returns at once");
+    drain(uart, queue, 10);
+    check(uart.sent == "OK\n" && !uart.attached && !queue.sending(), "the interrupt sends and then detaches itself");
+    queue.write("OK\n", 3);
+    drain(uart, queue, 10);
+    check(uart.sent == "OK\nOK\n" && uart.attaches == 2, "the next write attaches the interrupt again");
+
+    /** Writes and interrupts interleave at random; nothing may be lost or reordered */
+    srand(3);
+    std::string wanted;
+    uart.sent.clear();
+    for (int round = 0; round < 2000; round++) {
+        std::string chunk;
+        for (int i = rand() % 40; i > 0; i--)
+            chunk += char('a' + rand() % 26);
+        queue.write(chunk.data(), chunk.size());
+        wanted += chunk;
+        drain(uart, queue, rand() % 20);
+    }
+    drain(uart, queue, 100000);
+    check(queue.dropped() == 0 && uart.sent == wanted, "interleaved writes arrive whole and in order");
+    check(!uart.attached, "the interrupt is off once the ring is empty");
+
+    uart.sent.clear();
+    std::string burst(1000, 'x');
+    queue.write(burst.data(), burst.size());
+    drain(uart, queue, 100000);
+    check(uart.sent.size() == 255 && queue.dropped() == 1000 - 255,
+          "a burst larger than the ring is cut and the rest counted as dropped");
+}
+
+int main() {
+    checkParser();
+    checkRing();
+    checkCommands();
+    checkTxQueue();
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures != 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file tca8418_check.cpp
+ *
+ * @brief Host check of the TCA8418 keypad driver against a mock
+ * chip.
+ *
+ * Build and run on a host computer:
+ *
+ *   g++ -O2 -I.. -o tca8418_check tca8418_check.cpp ../Keypad.cpp
+ *   ./tca8418_check
+ *
+ * The mock chip has the TCA8418's register map, its 10 entry event
+ * FIFO that pops one event per KEY_EVENT_A read, the overflow flag
+ * and an INT line that stays low while INT_STAT has a flag set.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TCA8418.h"
+#include <deque>
+#include <functional>
+#include <stdio.h>
+#include <string>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s  %s\n", ok ? "pass" : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/** Callback type and microsecond clock the driver sees */
+struct MockPlatform {
+    struct Handler {
+        std::function<void()> function;
+
+        Handler() {}
+        Handler(void (*f)()) : function(f) {}
+        template<typename T>
+        Handler(T *object, void (T::*method)()) : function([=]() { (object->*method)(); }) {}
+
+        explicit operator bool() const {
+            return bool(function);
+        }
+        void operator()() const {
+            function();
+        }
+    };
+
+    static uint32_t now_us;
+
+    static uint32_t nowUs() {
+        return now_us;
+    }
+};
+
+uint32_t MockPlatform::now_us = 0;
+
+/** INT pin; the chip drives it and calls the falling edge handler */
+struct MockIrq {
+    int level;
+    MockPlatform::Handler fall_handler;
+
+    MockIrq() : level(1) {}
+
+    int read() {
+        return level;
+    }
+
+    void fall(MockPlatform::Handler handler) {
+        fall_handler = handler;
+    }
+};
+
+/** TCA8418 registers, FIFO and INT output */
+struct MockChip {
+    enum { CFG = 0x01, INT_STAT = 0x02, KEY_LCK_EC = 0x03, KEY_EVENT_A = 0x04, FIFO_SIZE = 10 };
+
+    uint8_t regs[256];
+    std::deque<uint8_t> fifo;
+    uint8_t pointer;
+    MockIrq &irq;
+    int transfers;
+    int fifo_reads;
+
+    explicit MockChip(MockIrq &pin) : pointer(0), irq(pin), transfers(0), fifo_reads(0) {
+        for (int i = 0; i < 256; i++)
+            regs[i] = 0;
+    }
+
+    /** A key matrix event as the chip's scanner queues it */
+    void queue(uint8_t event) {
+        if (fifo.size() == FIFO_SIZE)
+            regs[INT_STAT] |= 0x08;
+        else {
+            fifo.push_back(event);
+            regs[INT_STAT] |= 0x01;
+        }
+        updateInt();
+    }
+
+    void updateInt() {
+        int level = regs[INT_STAT] & 0x09 ? 0 : 1;
+        bool falling = irq.level == 1 && level == 0;
+        irq.level = level;
+        if (falling && irq.fall_handler)
+            irq.fall_handler();
+    }
+
+    int write(int address, const char *data, int length, bool = false) {
+        transfers++;
+        if (address != (0x34 << 1) || length < 1)
+            return -1;
+        pointer = data[0];
+        if (length == 2) {
+            /** INT_STAT flags clear when written with 1 */
+            if (pointer == INT_STAT)
+                regs[INT_STAT] &= ~data[1];
+            else
+                regs[pointer] = data[1];
+            updateInt();
+        }
+        return 0;
+    }
+
+    int read(int address, char *data, int length, bool = false) {
+        transfers++;
+        if (address != (0x34 << 1))
+            return -1;
+        if (pointer == KEY_EVENT_A)
+            fifo_reads++;
+        for (int i = 0; i < length; i++) {
+            if (pointer == KEY_LCK_EC)
+                data[i] = fifo.size();
+            else if (pointer == KEY_EVENT_A) {
+                data[i] = fifo.empty() ? 0 : fifo.front();
+                if (!fifo.empty())
+                    fifo.pop_front();
+            }
+            else
+                data[i] = regs[pointer];
+        }
+        return 0;
+    }
+};
+
+static const char key_map[4][4] = {
+        {'1', '2', '3', 'A'},
+        {'4', '5', '6', 'B'},
+        {'7', '8', '9', 'C'},
+        {'*', '0', '#', 'D'},
+};
+
+typedef TCA8418Keypad<4, 4, MockChip, MockIrq, MockPlatform> Keypad;
+
+/** Event byte for a key of the matrix: row*10 + col + 1, bit 7 for a press */
+static uint8_t keyByte(int row, int col, bool press) {
+    return (row*10 + col + 1) | (press ? 0x80 : 0);
+}
+
+/** Takes every queued event as "key+" for a press and "key-" for a release */
+static std::string takeEvents(Keypad &keypad) {
+    std::string text;
+    KeyEvent event;
+    while (keypad.get(event)) {
+        text += event.key;
+        text += event.type == KEY_PRESS ? '+' : event.type == KEY_RELEASE ? '-' : '?';
+    }
+    return text;
+}
+
+static int wakes = 0;
+
+static void wake() {
+    wakes++;
+}
+
+int main() {
+    MockIrq irq;
+    MockChip chip(irq);
+    Keypad keypad(chip, irq, key_map);
+    keypad.attach(wake);
+
+    check(chip.regs[0x1D] == 0x0F && chip.regs[0x1E] == 0x0F && chip.regs[0x1F] == 0x00,
+          "rows R0-R3 and columns C0-C3 are set up as the key matrix");
+    check(chip.regs[MockChip::CFG] == 0x19, "key event and overflow interrupts are enabled");
+
+    /** The first update drains whatever was queued before the driver started */
+    keypad.update(0);
+    check(takeEvents(keypad).empty() && keypad.idle(), "an empty FIFO gives no events");
+
+    printf("FIFO drain\n");
+    MockPlatform::now_us = 1000;
+    chip.queue(keyByte(1, 2, true));
+    MockPlatform::now_us = 1500;
+    chip.queue(keyByte(1, 2, false));
+    chip.queue(keyByte(3, 3, true));
+    check(wakes == 1 && !keypad.idle(), "the INT edge calls the attached handler once");
+
+    MockPlatform::now_us = 2000;
+    int transfers = chip.transfers;
+    keypad.update(10);
+    check(takeEvents(keypad) == "6+6-D+", "the queued events come out in order");
+    check(chip.fifo.empty() && chip.fifo_reads == 1, "the whole FIFO is read in one burst");
+    check(chip.transfers - transfers == 7, "a drain costs seven I2C transfers");
+    check(irq.level == 1 && chip.regs[MockChip::INT_STAT] == 0, "the interrupt is cleared and INT goes high");
+    check(keypad.pressEdgeUs() == 1000 && keypad.pressDetectUs() == 2000,
+          "the press keeps the time of its INT edge and of the drain");
+
+    chip.queue(keyByte(3, 3, false));
+    keypad.update(20);
+    check(takeEvents(keypad) == "D-" && keypad.idle(), "the keypad is idle once every key is released");
+
+    printf("Row and column decode\n");
+    std::string expected, got;
+    for (int row = 0; row < 4; row++)
+        for (int col = 0; col < 4; col++) {
+            chip.queue(keyByte(row, col, true));
+            chip.queue(keyByte(row, col, false));
+            keypad.update(30);
+            got += takeEvents(keypad);
+            expected += std::string(1, key_map[row][col]) + "+" + key_map[row][col] + "-";
+        }
+    check(got == expected, "every key of the 4x4 matrix maps to its character");
+
+    /** Column 4, row 4 and a GPI event are outside the 4x4 matrix */
+    chip.queue(keyByte(0, 4, true));
+    chip.queue(keyByte(4, 0, true));
+    chip.queue(0x80 | 97);
+    chip.queue(keyByte(0, 0, true));
+    keypad.update(40);
+    check(takeEvents(keypad) == "1+", "keys outside the matrix and GPI events are ignored");
+    chip.queue(keyByte(0, 0, false));
+    keypad.update(50);
+    takeEvents(keypad);
+
+    printf("FIFO overflow\n");
+    check(keypad.overflows() == 0, "no overflow so far");
+    for (int i = 0; i < 12; i++)
+        chip.queue(keyByte(2, i % 2, i % 4 < 2));
+    keypad.update(60);
+    std::string events = takeEvents(keypad);
+    printf("      %s\n", events.c_str());
+    check(keypad.overflows() == 1, "an overflow is counted once");
+    check(events.size() == 2*MockChip::FIFO_SIZE, "the ten events the chip kept are still read");
+    check(irq.level == 1 && chip.regs[MockChip::INT_STAT] == 0, "the overflow flag is cleared");
+
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures != 0;
+}
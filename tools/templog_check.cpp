@@ -0,0 +1,217 @@
+/**
+ * @file templog_check.cpp
+ *
+ * @brief Host check of the flash temperature log's block ring on
+ * a RAM block device.
+ *
+ * Build and run on a host computer:
+ *
+ *   g++ -O2 -I. -I.. -o templog_check templog_check.cpp ../TempLog.cpp
+ *   ./templog_check
+ *
+ * The RAM device behaves like NOR flash: erasing sets bytes to
+ * 0xFF, and programming can only clear bits, so a page programmed
+ * over unerased bytes is counted. It also counts erases per block
+ * and whether each one came from service() or from eraseAhead().
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TempLog.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s  %s\n", ok ? "pass" : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/** NOR flash in RAM, starting out as garbage like a never used sector */
+class RamFlash : public BlockDevice {
+public:
+    std::vector<uint8_t> memory;
+    std::vector<int> erases;
+    uint32_t block_size;
+    int unerased_programs;
+    int service_erases;
+    bool in_service;
+
+    RamFlash(uint32_t block, int blocks) :
+            memory(block * blocks, 0x5A), erases(blocks, 0), block_size(block),
+            unerased_programs(0), service_erases(0), in_service(false) {}
+
+    virtual int init() {
+        return 0;
+    }
+
+    virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) {
+        memcpy(buffer, &memory[addr], size);
+        return 0;
+    }
+
+    virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) {
+        const uint8_t *data = static_cast<const uint8_t *>(buffer);
+        bool erased = true;
+        for (bd_size_t i = 0; i < size; i++) {
+            erased = erased && memory[addr + i] == 0xFF;
+            memory[addr + i] &= data[i];
+        }
+        if (!erased)
+            unerased_programs++;
+        return 0;
+    }
+
+    virtual int erase(bd_addr_t addr, bd_size_t size) {
+        memset(&memory[addr], 0xFF, size);
+        erases[addr / block_size]++;
+        if (in_service)
+            service_erases++;
+        return 0;
+    }
+
+    virtual bd_size_t get_erase_size() const {
+        return block_size;
+    }
+
+    virtual bd_size_t size() const {
+        return memory.size();
+    }
+};
+
+/** Runs the log the way lcd_clock.cpp's log events do */
+static void logSample(TempLog &log, RamFlash &flash, uint32_t time, int16_t temp, bool erase_ahead) {
+    log.append(time, temp);
+    flash.in_service = true;
+    log.service();
+    flash.in_service = false;
+    if (erase_ahead && log.eraseDue())
+        log.eraseAhead();
+}
+
+/** Reads the log back and checks it is a run of one sample a minute */
+struct Readback {
+    uint32_t count, first, last;
+    bool ordered;
+
+    Readback() : count(0), first(0), last(0), ordered(true) {}
+
+    void operator()(uint32_t time, int16_t temp) {
+        if (count == 0)
+            first = time;
+        else if (time != last + 60)
+            ordered = false;
+        if (temp != int16_t(200 + (time / 60) % 50))
+            ordered = false;
+        last = time;
+        count++;
+    }
+};
+
+static int16_t sampleAt(uint32_t time) {
+    return 200 + (time / 60) % 50;
+}
+
+/** forEach() takes its visitor by value, so the tally is kept by reference */
+static Readback readBack(TempLog &log) {
+    Readback tally;
+    log.forEach([&](uint32_t time, int16_t temp) { tally(time, temp); });
+    return tally;
+}
+
+int main() {
+    const uint32_t BLOCK = 4096;
+    const int BLOCKS = 4;
+    const uint32_t START = 1700000040;
+
+    printf("Filling the ring\n");
+    RamFlash flash(BLOCK, BLOCKS);
+    TempLog log(flash);
+    check(log.init() == 0, "init() on a device that never held a log");
+
+    uint32_t time = START;
+    for (int i = 0; i < 1000; i++, time += 60)
+        logSample(log, flash, time, sampleAt(time), true);
+    log.flush();
+    log.service();
+
+    Readback first = readBack(log);
+    printf("      %lu samples logged, %lu read back\n", (unsigned long)log.stats().samples,
+           (unsigned long)first.count);
+    check(first.count == 1000 && first.first == START && first.ordered,
+          "every sample reads back in order before the ring wraps");
+
+    for (int i = 0; i < 100000; i++, time += 60)
+        logSample(log, flash, time, sampleAt(time), true);
+    log.flush();
+    log.service();
+
+    Readback wrapped = readBack(log);
+    uint32_t logged = log.stats().samples;
+    printf("      %lu samples logged, %lu read back, erases per block", (unsigned long)logged,
+           (unsigned long)wrapped.count);
+    int fewest = flash.erases[0], most = flash.erases[0];
+    for (int i = 0; i < BLOCKS; i++) {
+        printf(" %d", flash.erases[i]);
+        fewest = flash.erases[i] < fewest ? flash.erases[i] : fewest;
+        most = flash.erases[i] > most ? flash.erases[i] : most;
+    }
+    printf("\n");
+    check(wrapped.ordered && wrapped.last == time - 60,
+          "after wrapping, the newest samples read back in order up to the last one");
+    check(wrapped.count > logged / 101 && wrapped.count < logged,
+          "the oldest blocks were dropped to make room");
+    check(most - fewest <= 1, "every block is erased equally often");
+    check(flash.unerased_programs == 0, "no page is programmed over unerased bytes");
+    /** Nothing was erased ahead of the very first block */
+    check(flash.service_erases == 1, "with eraseAhead() running, service() only erases the first block");
+
+    printf("Resuming after a reset\n");
+    for (int i = 0; i < 10; i++, time += 60)
+        logSample(log, flash, time, sampleAt(time), true);
+    uint32_t lost_from = time - 10*60;
+
+    /** The RAM page is lost; a new log object finds the newest block */
+    TempLog resumed(flash);
+    check(resumed.init() == 0, "init() finds the newest block");
+    Readback before = readBack(resumed);
+    check(before.ordered && before.last == lost_from - 60,
+          "only the unwritten RAM page is lost");
+
+    for (int i = 0; i < 100; i++, time += 60)
+        logSample(resumed, flash, time, sampleAt(time), true);
+    resumed.flush();
+    resumed.service();
+    Readback after = readBack(resumed);
+    check(after.last == time - 60 && after.count > before.count, "appending carries on after the resumed block");
+
+    printf("Without eraseAhead()\n");
+    RamFlash plain(BLOCK, BLOCKS);
+    TempLog fallback(plain);
+    fallback.init();
+    time = START;
+    for (int i = 0; i < 5000; i++, time += 60)
+        logSample(fallback, plain, time, sampleAt(time), false);
+    fallback.flush();
+    fallback.service();
+    Readback fallback_read = readBack(fallback);
+    check(plain.service_erases > 0 && plain.unerased_programs == 0 && fallback_read.ordered,
+          "service() erases each block as it opens");
+
+    printf("Page queue\n");
+    RamFlash starved(BLOCK, BLOCKS);
+    TempLog unserviced(starved);
+    unserviced.init();
+    time = START;
+    for (int i = 0; i < 500; i++, time += 60)
+        unserviced.append(time, sampleAt(time));
+    check(unserviced.stats().dropped > 0, "samples are dropped, not blocked on, when service() does not run");
+
+    unserviced.printStats();
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures != 0;
+}
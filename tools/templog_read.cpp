@@ -0,0 +1,213 @@
+/**
+ * @file templog_read.cpp
+ *
+ * @brief Host tool that decodes a raw dump of the temperature
+ * history log, and measures the log format.
+ *
+ * Build and use on a host computer:
+ *
+ *   g++ -O2 -I.. -o templog_read templog_read.cpp
+ *   st-flash read log.bin 0x08020000 0x40000
+ *   ./templog_read log.bin > history.csv
+ *   ./templog_read -b 7
+ *
+ * The first form prints every sample of the dump as CSV, oldest
+ * first. The second packs a synthetic run of per minute samples
+ * the way TempLog does and reports bytes per sample, write
+ * amplification and decode speed.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TempLogFormat.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+/** Erase block of the log on the STM32F401RE, sectors 5 and 6 */
+static const uint32_t DEFAULT_BLOCK_SIZE = 0x20000;
+
+/** Prints one sample as a CSV line */
+static void printSample(uint32_t time, int16_t temp) {
+    time_t t = time;
+    struct tm utc;
+    char stamp[32];
+    gmtime_r(&t, &utc);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    printf("%s,%d.%d\n", stamp, temp / 10, abs(temp % 10));
+}
+
+/** Decodes every block of a dump in the order they were opened */
+static int readDump(const char *path, uint32_t block_size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 1;
+    }
+    std::vector<uint8_t> dump;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        dump.insert(dump.end(), chunk, chunk + n);
+    fclose(file);
+
+    if (dump.size() < block_size || dump.size() % block_size) {
+        fprintf(stderr, "%s: size %zu is not a whole number of %lu byte blocks\n",
+                path, dump.size(), (unsigned long)block_size);
+        return 1;
+    }
+
+    /** The block with the lowest sequence number is the oldest */
+    std::vector<std::pair<uint32_t, uint32_t> > blocks;
+    for (uint32_t base = 0; base < dump.size(); base += block_size) {
+        TempLogHeader header;
+        if (tempLogHeader(&dump[base], header))
+            blocks.push_back(std::make_pair(header.sequence, base));
+    }
+    std::sort(blocks.begin(), blocks.end());
+
+    printf("time,temp_c\n");
+    for (size_t i = 0; i < blocks.size(); i++) {
+        TempLogState state;
+        tempLogDecodeBlock(&dump[blocks[i].second], block_size, printSample, state);
+    }
+    fprintf(stderr, "%zu of %zu blocks hold samples\n", blocks.size(), dump.size() / block_size);
+    return 0;
+}
+
+/**
+ * @brief Packs samples into blocks as TempLog does: a header page
+ * per block, then pages of records behind a count byte.
+ */
+struct Packer {
+    uint32_t block_size;
+    std::vector<uint8_t> image;
+    uint8_t page[TEMPLOG_PAGE_SIZE];
+    int page_used;
+    uint32_t page_offset;
+    uint32_t sequence;
+    TempLogState state;
+    uint32_t samples, record_bytes, programmed_bytes;
+
+    explicit Packer(uint32_t size) :
+            block_size(size), page_used(0), page_offset(0), sequence(0), state(),
+            samples(0), record_bytes(0), programmed_bytes(0) {}
+
+    void append(uint32_t time, int16_t temp) {
+        uint8_t record[TEMPLOG_MAX_RECORD];
+        TempLogState next = state;
+        int length = tempLogEncode(record, next, time, temp);
+
+        if (!image.empty() && page_used + length > TEMPLOG_PAGE_SIZE - 1)
+            closePage();
+        if (image.empty() || (page_used == 0 && page_offset + TEMPLOG_PAGE_SIZE > block_size)) {
+            openBlock(time, temp);
+            return;
+        }
+
+        memcpy(page + 1 + page_used, record, length);
+        page_used += length;
+        state = next;
+        samples++;
+        record_bytes += length;
+    }
+
+    void openBlock(uint32_t time, int16_t temp) {
+        TempLogHeader header;
+        header.magic = TEMPLOG_MAGIC;
+        header.sequence = ++sequence;
+        header.time = time;
+        header.temp = temp;
+        header.check = tempLogCheck(header);
+
+        image.resize(image.size() + block_size, TEMPLOG_ERASED);
+        memcpy(&image[image.size() - block_size], &header, sizeof(header));
+        page_offset = TEMPLOG_PAGE_SIZE;
+        page_used = 0;
+        tempLogStart(header, state);
+        samples++;
+        record_bytes += sizeof(header);
+        programmed_bytes += TEMPLOG_PAGE_SIZE;
+    }
+
+    void closePage() {
+        page[0] = page_used;
+        memset(page + 1 + page_used, TEMPLOG_ERASED, TEMPLOG_PAGE_SIZE - 1 - page_used);
+        memcpy(&image[image.size() - block_size + page_offset], page, TEMPLOG_PAGE_SIZE);
+        page_offset += TEMPLOG_PAGE_SIZE;
+        page_used = 0;
+        programmed_bytes += TEMPLOG_PAGE_SIZE;
+    }
+};
+
+/**
+ * @brief Logs a synthetic run of per minute samples and decodes
+ * it back.
+ *
+ * The temperature drifts through a daily cycle with a tenth of a
+ * degree of noise, and about one sample in fifty comes a second
+ * late, as the device's minute timer does when the loop is busy.
+ */
+static int benchmark(int days) {
+    Packer packer(DEFAULT_BLOCK_SIZE);
+    std::vector<std::pair<uint32_t, int16_t> > samples;
+
+    srand(1);
+    uint32_t time = 1700000000;
+    for (int i = 0; i < days*24*60; i++) {
+        time += rand() % 50 ? 60 : 61;
+        int daily = (i % 1440 < 720 ? i % 1440 : 1440 - i % 1440) * 60 / 720;
+        int16_t temp = 200 + daily + rand() % 3 - 1;
+        packer.append(time, temp);
+        samples.push_back(std::make_pair(time, temp));
+    }
+    if (packer.page_used > 0)
+        packer.closePage();
+
+    /** Decode every block many times to time the reader */
+    const int RUNS = 200;
+    size_t decoded = 0, bad = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < RUNS; run++) {
+        size_t index = 0;
+        auto check = [&](uint32_t t, int16_t temp) {
+            if (index >= samples.size() || samples[index].first != t || samples[index].second != temp)
+                bad++;
+            index++;
+        };
+        for (uint32_t base = 0; base < packer.image.size(); base += DEFAULT_BLOCK_SIZE) {
+            TempLogState state;
+            tempLogDecodeBlock(&packer.image[base], DEFAULT_BLOCK_SIZE, check, state);
+        }
+        decoded += index;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("samples         %lu over %d days\n", (unsigned long)packer.samples, days);
+    printf("record bytes    %lu (%.3f per sample)\n", (unsigned long)packer.record_bytes,
+           double(packer.record_bytes) / packer.samples);
+    printf("programmed      %lu (%.3f per sample)\n", (unsigned long)packer.programmed_bytes,
+           double(packer.programmed_bytes) / packer.samples);
+    printf("write amp       %.3f\n", double(packer.programmed_bytes) / packer.record_bytes);
+    printf("blocks          %lu of %lu bytes\n", (unsigned long)(packer.image.size() / DEFAULT_BLOCK_SIZE),
+           (unsigned long)DEFAULT_BLOCK_SIZE);
+    printf("decode          %.1f M samples/s\n", decoded / seconds / 1e6);
+    printf("mismatches      %lu\n", (unsigned long)bad);
+    return bad != 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "-b") == 0)
+        return benchmark(argc >= 3 ? atoi(argv[2]) : 7);
+    if (argc == 2 || argc == 3)
+        return readDump(argv[1], argc == 3 ? strtoul(argv[2], NULL, 0) : DEFAULT_BLOCK_SIZE);
+
+    fprintf(stderr, "usage: %s dump.bin [block_size]\n"
+                    "       %s -b [days]\n", argv[0], argv[0]);
+    return 2;
+}
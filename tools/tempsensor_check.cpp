@@ -0,0 +1,355 @@
+/**
+ * @file tempsensor_check.cpp
+ *
+ * @brief Host check of the bus temperature drivers and the sensor
+ * scheduler against mock buses.
+ *
+ * Build and run on a host computer:
+ *
+ *   g++ -O2 -I.. -o tempsensor_check tempsensor_check.cpp ../TempSensor.cpp
+ *   ./tempsensor_check
+ *
+ * The mock 1-Wire bus holds any number of DS18B20s that answer
+ * SKIP ROM and MATCH ROM, convert for 750 ms and send a scratchpad
+ * with its CRC. The mock I2C bus holds a TMP102 with its one-shot
+ * conversion and OS bit. Both run on a shared simulated clock, so
+ * the scheduler sees the same timing as on the board.
+ *
+ * @author Levi Vande Kerkhoff
+ *
+ */
+
+#include "TempSensor.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/** Simulated milliseconds, shared by the mocks and the scheduler */
+static uint32_t now_ms = 0;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s  %s\n", ok ? "pass" : "FAIL", what);
+    if (!ok)
+        failures++;
+}
+
+/** One DS18B20 on the mock 1-Wire bus */
+struct MockDS18B20 {
+    uint8_t rom[8];
+    uint8_t scratchpad[9];
+    uint32_t conversion_ms;     /**< how long a conversion takes */
+    bool hangs;                 /**< never finishes a conversion */
+
+    enum State { IDLE, ROM_COMMAND, MATCHING, FUNCTION, READING };
+    State state;
+    bool selected;
+    int position;
+    bool converting;
+    uint32_t convert_start;
+
+    MockDS18B20(uint8_t serial, int16_t sixteenths) :
+            conversion_ms(750), hangs(false), state(IDLE), selected(false),
+            position(0), converting(false), convert_start(0) {
+        const uint8_t code[7] = {0x28, serial, 0, 0, 0, 0, 0};
+        memcpy(rom, code, 7);
+        rom[7] = oneWireCrc8(rom, 7);
+        setTemperature(sixteenths);
+    }
+
+    void setTemperature(int16_t sixteenths) {
+        const uint8_t pad[8] = {uint8_t(sixteenths), uint8_t(sixteenths >> 8), 0x4B, 0x46, 0x7F, 0xFF, 0x01, 0x10};
+        memcpy(scratchpad, pad, 8);
+        scratchpad[8] = oneWireCrc8(scratchpad, 8);
+    }
+
+    bool busy() const {
+        return converting && (hangs || now_ms - convert_start < conversion_ms);
+    }
+
+    void reset() {
+        state = ROM_COMMAND;
+        selected = false;
+    }
+
+    void writeByte(uint8_t value) {
+        switch (state) {
+        case ROM_COMMAND:
+            if (value == 0xCC) {
+                selected = true;
+                state = FUNCTION;
+            }
+            else if (value == 0x55) {
+                selected = true;
+                position = 0;
+                state = MATCHING;
+            }
+            else
+                state = IDLE;
+            break;
+        case MATCHING:
+            selected = selected && value == rom[position];
+            if (++position == 8)
+                state = FUNCTION;
+            break;
+        case FUNCTION:
+            if (!selected)
+                state = IDLE;
+            else if (value == 0x44) {
+                converting = true;
+                convert_start = now_ms;
+                state = IDLE;
+            }
+            else if (value == 0xBE) {
+                position = 0;
+                state = READING;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    /** @return the bit this device drives, 1 if it leaves the bus alone */
+    int readBit() {
+        if (converting && !busy())
+            converting = false;
+        return converting ? 0 : 1;
+    }
+
+    uint8_t readByte() {
+        if (state != READING || !selected || position >= 9)
+            return 0xFF;
+        return scratchpad[position++];
+    }
+};
+
+/** 1-Wire bus: the devices pull the line low together, wired-AND */
+struct MockOneWire {
+    std::vector<MockDS18B20 *> devices;
+
+    bool reset() {
+        for (size_t i = 0; i < devices.size(); i++)
+            devices[i]->reset();
+        return !devices.empty();
+    }
+
+    void writeByte(uint8_t value) {
+        for (size_t i = 0; i < devices.size(); i++)
+            devices[i]->writeByte(value);
+    }
+
+    uint8_t readByte() {
+        uint8_t value = 0xFF;
+        for (size_t i = 0; i < devices.size(); i++)
+            value &= devices[i]->readByte();
+        return value;
+    }
+
+    int readBit() {
+        int bit = 1;
+        for (size_t i = 0; i < devices.size(); i++)
+            bit &= devices[i]->readBit();
+        return bit;
+    }
+};
+
+/** TMP102 on a mock I2C bus, with mbed's I2C return codes */
+struct MockTMP102 {
+    int address;
+    int16_t sixteenths;
+    uint8_t pointer;
+    uint8_t config[2];
+    bool converting;
+    uint32_t convert_start;
+
+    MockTMP102() :
+            address(0x48 << 1), sixteenths(0), pointer(0), converting(false), convert_start(0) {
+        config[0] = 0x60;
+        config[1] = 0xA0;
+    }
+
+    bool busy() {
+        if (converting && now_ms - convert_start >= 26)
+            converting = false;
+        return converting;
+    }
+
+    int write(int to, const char *data, int length, bool = false) {
+        if (to != address || length < 1)
+            return -1;
+        pointer = data[0];
+        if (length == 3 && pointer == 0x01) {
+            config[0] = data[1] & 0x7F;
+            config[1] = data[2];
+            if ((data[1] & 0x80) && (data[1] & 0x01)) {
+                converting = true;
+                convert_start = now_ms;
+            }
+        }
+        return 0;
+    }
+
+    int read(int from, char *data, int length, bool = false) {
+        if (from != address || length != 2)
+            return -1;
+        if (pointer == 0x01) {
+            data[0] = config[0] | (busy() ? 0 : 0x80);
+            data[1] = config[1];
+        }
+        else {
+            uint16_t value = uint16_t(sixteenths) << 4;
+            data[0] = value >> 8;
+            data[1] = value & 0xFF;
+        }
+        return 0;
+    }
+};
+
+/** Starts a conversion and reads it once the sensor is done */
+static bool convert(TempSensor &sensor, int16_t &tenths_c, int &polls) {
+    if (!sensor.start())
+        return false;
+    for (polls = 1; !sensor.poll(); polls++) {
+        now_ms += 1;
+        if (polls > 10000)
+            return false;
+    }
+    return sensor.read(tenths_c);
+}
+
+static void checkDS18B20() {
+    printf("DS18B20 on a mock 1-Wire bus\n");
+    MockOneWire bus;
+    MockDS18B20 device(1, 0x0191);
+    bus.devices.push_back(&device);
+    DS18B20Sensor<MockOneWire> sensor(bus);
+
+    /** Datasheet table 1: raw reading and temperature */
+    const struct { int16_t raw; int16_t tenths; } table[] = {
+            {0x07D0, 1250}, {0x0191, 251}, {0x00A2, 101}, {0x0008, 5},
+            {0x0000, 0}, {int16_t(0xFFF8), -5}, {int16_t(0xFF5E), -101}, {int16_t(0xFC90), -550},
+    };
+    bool all = true;
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        device.setTemperature(table[i].raw);
+        int16_t tenths = 0;
+        int polls = 0;
+        all = all && convert(sensor, tenths, polls) && tenths == table[i].tenths;
+    }
+    check(all, "datasheet readings from +125 to -55 C convert to tenths, rounded");
+
+    device.setTemperature(0x0191);
+    int16_t tenths;
+    int polls;
+    uint32_t start = now_ms;
+    convert(sensor, tenths, polls);
+    check(now_ms - start >= 750 && now_ms - start <= 751, "poll() reads 0 until the 750 ms conversion is done");
+
+    device.scratchpad[2] ^= 0x01;
+    check(!sensor.read(tenths), "a corrupted scratchpad fails the CRC");
+    device.setTemperature(0x0191);
+
+    MockDS18B20 second(2, int16_t(0xFF5E));
+    bus.devices.push_back(&second);
+    DS18B20Sensor<MockOneWire> first_sensor(bus, device.rom);
+    DS18B20Sensor<MockOneWire> second_sensor(bus, second.rom);
+    int16_t a = 0, b = 0;
+    bool ok = convert(first_sensor, a, polls) && convert(second_sensor, b, polls);
+    check(ok && a == 251 && b == -101, "MATCH ROM reads each of two sensors on one bus");
+
+    MockOneWire empty;
+    DS18B20Sensor<MockOneWire> missing(empty);
+    check(!missing.start() && !missing.read(tenths), "no presence pulse fails start() and read()");
+}
+
+static void checkTMP1xx() {
+    printf("TMP102 on a mock I2C bus\n");
+    MockTMP102 chip;
+    TMP1xxSensor<MockTMP102> sensor(chip);
+
+    const struct { int16_t raw; int16_t tenths; } table[] = {
+            {0x7FF, 1279}, {0x640, 1000}, {0x190, 250}, {0x004, 3},
+            {0x000, 0}, {-1, -1}, {-400, -250}, {-880, -550},
+    };
+    bool all = true;
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        chip.sixteenths = table[i].raw;
+        int16_t tenths = 0;
+        int polls = 0;
+        all = all && convert(sensor, tenths, polls) && tenths == table[i].tenths;
+    }
+    check(all, "12-bit readings from +128 to -55 C convert to tenths, rounded");
+
+    int16_t tenths;
+    int polls;
+    uint32_t start = now_ms;
+    convert(sensor, tenths, polls);
+    check(now_ms - start >= 26 && now_ms - start < uint32_t(sensor.conversionMs()),
+          "the OS bit reads 0 until the one-shot conversion is done");
+    check((chip.config[1] & 0xFF) == 0xA0 && (chip.config[0] & 0x01), "the sensor is left in shutdown");
+
+    chip.address = 0x49 << 1;
+    check(!sensor.start() && !sensor.read(tenths), "a NACK fails start() and read()");
+}
+
+static void checkScheduler() {
+    printf("TempSensorScheduler, updated every 100 ms like sensorTick\n");
+    MockOneWire one_wire;
+    MockDS18B20 ds18b20(1, 0x0191);
+    one_wire.devices.push_back(&ds18b20);
+    DS18B20Sensor<MockOneWire> slow(one_wire);
+
+    MockTMP102 chip;
+    chip.sixteenths = 0x190;
+    TMP1xxSensor<MockTMP102> fast(chip);
+
+    MockOneWire hung_bus;
+    MockDS18B20 hung_device(2, 0);
+    hung_device.hangs = true;
+    hung_bus.devices.push_back(&hung_device);
+    DS18B20Sensor<MockOneWire> hung(hung_bus);
+
+    MockOneWire no_bus;
+    DS18B20Sensor<MockOneWire> missing(no_bus);
+
+    TempSensorScheduler scheduler(1000);
+    check(scheduler.add(slow) && scheduler.add(fast) && scheduler.add(hung) && scheduler.add(missing),
+          "four sensors are added");
+    MockOneWire extra_bus;
+    DS18B20Sensor<MockOneWire> extra(extra_bus);
+    check(!scheduler.add(extra), "a fifth sensor is refused");
+
+    const uint32_t SECONDS = 60;
+    now_ms = 0;
+    for (uint32_t t = 0; t < SECONDS*1000; t += 100) {
+        now_ms = t;
+        scheduler.update(now_ms);
+    }
+
+    for (int i = 0; i < scheduler.count(); i++) {
+        TempSample sample = scheduler.reading(i);
+        printf("      sensor %d: %lu readings, last %d, %lu errors\n", i,
+               (unsigned long)sample.count, sample.tenths_c, (unsigned long)scheduler.errors(i));
+    }
+
+    /** Conversions overlap, so the 750 ms one still keeps the 1 s period */
+    check(scheduler.reading(0).count >= SECONDS - 2 && scheduler.reading(0).tenths_c == 251,
+          "the DS18B20 reads once a second next to the others");
+    check(scheduler.reading(1).count >= SECONDS - 2 && scheduler.reading(1).tenths_c == 250,
+          "the TMP102 reads once a second next to the others");
+    /** A hung conversion is given up after twice 750 ms, then retried */
+    check(scheduler.reading(2).count == 0 && scheduler.errors(2) >= SECONDS*1000 / 1700,
+          "a hung conversion times out, counts an error and is retried");
+    check(scheduler.reading(3).count == 0 && scheduler.errors(3) >= SECONDS - 2,
+          "a missing sensor counts an error each period");
+}
+
+int main() {
+    checkDS18B20();
+    checkTMP1xx();
+    checkScheduler();
+    printf("%s\n", failures ? "FAILED" : "all checks passed");
+    return failures != 0;
+}